@@ -0,0 +1,205 @@
+// Equal time convergence of the built in scenes: error against a converged reference per second of
+// rendering, so sampling changes that trade speed for variance are judged by time to quality.
+//
+// Each scene's reference is rendered once at --reference-spp and cached as a .pfm in --cache, named
+// by scene, width, samples, seed and reference_version, which is bumped whenever how references are
+// rendered changes so older ones are never reused (delete them when the scene itself changes).  The current build is
+// then rendered at each time budget, with the samples per pixel that 1 and 8 spp renders say fit it,
+// and the RMSE and relMSE against the reference are reported with the render's actual time.
+//
+// Bias: each pixel's luminance error against the reference is independent between pixels, so
+// an unbiased render's mean error is within a few standard errors of 0.  A mean error more than
+// --bias-z standard errors from 0 is flagged, and the exit status is then 1.
+//
+//   make bench_convergence   (from c++/src)
+//
+// Options: --width N  --reference-spp N  --budgets S,S,...  --seed N  --cache DIR  --bias-z Z
+//          --denoise  --scene NAME (repeatable, default all)
+
+#include "scenes.h"
+#include "pfm.h"
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+struct convergence_config {
+    int width = 80;
+    int reference_spp = 1024;
+    std::vector<double> budgets = {0.25, 0.5, 1, 2};  // seconds
+    unsigned int seed = 1;
+    std::string cache = "../out/references";
+    double bias_z = 4;
+    bool denoise = false;
+    std::vector<std::string> scenes;
+};
+
+// Version 2: scenes are built from the seed before the samples' own seed, and the random numbers
+// come from a per thread mt19937 rather than rand()
+const int reference_version = 2;
+
+struct render_result {
+    std::vector<color> image;
+    double seconds;
+};
+
+// The scene is always built from scene_seed, so every render sees the same geometry (random_spheres,
+// final_scene and many_lights are random), and sample_seed seeds its samples
+static render_result render_scene(const named_scene& entry, int width, int spp, unsigned int scene_seed,
+                                  unsigned int sample_seed, bool denoise) {
+    seed_random(scene_seed);
+    scene s = entry.build();
+    seed_random(sample_seed);
+    s.cam.image_width = width;
+    s.cam.samples_per_pixel = spp;
+    s.cam.write_image = false;
+    s.cam.denoise = denoise;
+
+    auto start = std::chrono::steady_clock::now();
+    s.render();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return render_result{s.cam.rendered_image(), elapsed.count()};
+}
+
+// The cached reference, rendered and cached first if there isn't one
+static std::vector<color> reference_for(const named_scene& entry, const convergence_config& config) {
+    std::ostringstream filename;
+    filename << config.cache << '/' << entry.name << "_w" << config.width << "_s" << config.reference_spp
+             << "_seed" << config.seed << "_v" << reference_version << ".pfm";
+
+    // the height the scene's camera gives at this width, a cached image of another size is stale
+    seed_random(config.seed);
+    scene s = entry.build();
+    s.cam.image_width = config.width;
+    int expected_height = s.cam.height();
+
+    std::vector<float> rgb;
+    int width, height;
+    if (read_pfm(filename.str(), rgb, width, height) && width == config.width && height == expected_height) {
+        std::vector<color> image(static_cast<size_t>(width) * height);
+        for (size_t p = 0; p < image.size(); p++) image[p] = color(rgb[3*p], rgb[3*p + 1], rgb[3*p + 2]);
+        return image;
+    }
+
+    std::cerr << "Rendering the " << entry.name << " reference at " << config.reference_spp << " spp...\n";
+    render_result reference = render_scene(entry, config.width, config.reference_spp, config.seed, config.seed + 1000, false);
+
+    rgb.clear();
+    for (const color& c : reference.image) {
+        for (int i = 0; i < 3; i++) rgb.push_back(static_cast<float>(c[i]));
+    }
+    mkdir(config.cache.c_str(), 0755);
+    height = static_cast<int>(reference.image.size() / config.width);
+    if (!write_pfm(filename.str(), rgb.data(), config.width, height)) {
+        std::cerr << "ERROR: Could not cache the reference '" << filename.str() << "'.\n";
+    }
+    return reference.image;
+}
+
+// Mean of (x - r)^2 / (r^2 + 0.01) over every pixel and channel
+static double rel_mse(const std::vector<color>& x, const std::vector<color>& reference) {
+    double sum = 0;
+    for (size_t p = 0; p < x.size(); p++) {
+        for (int i = 0; i < 3; i++) {
+            double d = x[p][i] - reference[p][i];
+            sum += d * d / (reference[p][i] * reference[p][i] + 0.01);
+        }
+    }
+    return sum / (3.0 * x.size());
+}
+
+// How many standard errors the mean luminance error is from 0
+static double bias_z_score(const std::vector<color>& x, const std::vector<color>& reference) {
+    double sum = 0, sum_sq = 0;
+    for (size_t p = 0; p < x.size(); p++) {
+        double d = luminance(x[p]) - luminance(reference[p]);
+        sum += d;
+        sum_sq += d * d;
+    }
+    double n = static_cast<double>(x.size());
+    double mean = sum / n;
+    double variance = std::fmax(sum_sq / n - mean * mean, 0.0);
+    double standard_error = std::sqrt(variance / n);
+    return standard_error > 0 ? mean / standard_error : 0.0;
+}
+
+static bool parse_args(int argc, char* argv[], convergence_config& config) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--denoise") {
+            config.denoise = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            std::cerr << "ERROR: Missing value for '" << arg << "'.\n";
+            return false;
+        }
+        std::string value = argv[++i];
+
+        if (arg == "--width") config.width = std::atoi(value.c_str());
+        else if (arg == "--reference-spp") config.reference_spp = std::atoi(value.c_str());
+        else if (arg == "--seed") config.seed = static_cast<unsigned int>(std::atoi(value.c_str()));
+        else if (arg == "--cache") config.cache = value;
+        else if (arg == "--bias-z") config.bias_z = std::atof(value.c_str());
+        else if (arg == "--scene") config.scenes.push_back(value);
+        else if (arg == "--budgets") {
+            config.budgets.clear();
+            std::istringstream list(value);
+            std::string budget;
+            while (std::getline(list, budget, ',')) config.budgets.push_back(std::atof(budget.c_str()));
+        } else {
+            std::cerr << "ERROR: Unknown option '" << arg << "'.\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    convergence_config config;
+    if (!parse_args(argc, argv, config)) return 2;
+
+    std::clog.rdbuf(nullptr);  // no progress or timing text from the camera
+
+    std::printf("%-22s %8s %6s %8s %10s %10s %8s\n", "scene", "budget", "spp", "time", "RMSE", "relMSE", "bias z");
+
+    int biased = 0;
+    for (const named_scene& entry : builtin_scenes()) {
+        bool wanted = config.scenes.empty();
+        for (const auto& name : config.scenes) wanted = wanted || name == entry.name;
+        if (!wanted) continue;
+
+        std::vector<color> reference = reference_for(entry, config);
+
+        // time = fixed + per_spp * spp, from 1 and 8 spp renders after a first render has warmed the
+        // caches.  The fixed part (denoising, setup) matters at small budgets
+        render_scene(entry, config.width, 1, config.seed, config.seed, config.denoise);
+        double t1 = render_scene(entry, config.width, 1, config.seed, config.seed, config.denoise).seconds;
+        double t8 = render_scene(entry, config.width, 8, config.seed, config.seed, config.denoise).seconds;
+        double per_spp = std::max((t8 - t1) / 7, 1e-9);
+        double fixed = std::max(t1 - per_spp, 0.0);
+
+        for (size_t b = 0; b < config.budgets.size(); b++) {
+            int spp = std::max(1, static_cast<int>((config.budgets[b] - fixed) / per_spp));
+            render_result r = render_scene(entry, config.width, spp, config.seed, config.seed + static_cast<unsigned int>(b), config.denoise);
+
+            double z = bias_z_score(r.image, reference);
+            bool flagged = std::fabs(z) > config.bias_z;
+            if (flagged) biased++;
+
+            std::printf("%-22s %7.2fs %6d %7.2fs %10.5f %10.5f %8.2f%s\n", entry.name, config.budgets[b], spp,
+                        r.seconds, rmse(r.image, reference), rel_mse(r.image, reference), z, flagged ? "  BIASED" : "");
+            std::fflush(stdout);
+        }
+    }
+
+    return biased > 0 ? 1 : 0;
+}
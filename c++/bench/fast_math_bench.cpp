@@ -0,0 +1,80 @@
+// Accuracy and speed of the fast_math.h kernels against <cmath>.
+//
+// For each kernel: the max error over a dense sweep of its domain, and the time per call of
+// the libm function and the approximation over the same inputs.
+//
+//   make bench_math   (from c++/src)
+
+#include "fast_math.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+static const int count = 1 << 16;
+static const int repeats = 200;
+
+// ns per call of f over inputs, summing the results so the calls can't be optimised away
+template <typename F>
+double time_per_call(const std::vector<double>& x, const std::vector<double>& y, F f, double& sink) {
+    auto start = std::chrono::steady_clock::now();
+    double sum = 0;
+    for (int r = 0; r < repeats; r++) {
+        for (int i = 0; i < count; i++) sum += f(x[i], y[i]);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    sink += sum;
+    return 1e9 * seconds / (static_cast<double>(repeats) * count);
+}
+
+template <typename Exact, typename Fast>
+void report(const char* name, const char* error_kind, double lo, double hi,
+            Exact exact, Fast fast, double& sink) {
+    std::vector<double> x(count), y(count);
+    for (int i = 0; i < count; i++) {
+        // a shuffled sweep of [lo, hi], y sweeps [-1, 1] for the two argument kernels
+        double t = static_cast<double>((i * 40503LL) % count) / (count - 1);
+        x[i] = lo + (hi - lo) * t;
+        y[i] = -1 + 2 * static_cast<double>((i * 7919LL) % count) / (count - 1);
+    }
+
+    double max_error = 0;
+    for (int i = 0; i < count; i++) {
+        double e = exact(x[i], y[i]), f = fast(x[i], y[i]);
+        double error = std::fabs(f - e);
+        if (error_kind[0] == 'r') error /= std::fmax(std::fabs(e), 1e-300);
+        max_error = std::fmax(max_error, error);
+    }
+
+    double libm_ns = time_per_call(x, y, exact, sink);
+    double fast_ns = time_per_call(x, y, fast, sink);
+
+    std::printf("%-8s %-4s error %-9.2g libm %6.2f ns  fast %6.2f ns  speedup %5.2fx\n",
+                name, error_kind, max_error, libm_ns, fast_ns, libm_ns / fast_ns);
+}
+
+int main() {
+    double sink = 0;
+
+    report("acos", "abs", -1, 1,
+           [](double x, double) { return std::acos(x); },
+           [](double x, double) { return fast_acos(x); }, sink);
+    report("atan2", "abs", -1, 1,
+           [](double x, double y) { return std::atan2(y, x); },
+           [](double x, double y) { return fast_atan2(y, x); }, sink);
+    report("pow5", "rel", 1e-3, 1,
+           [](double x, double) { return std::pow(x, 5); },
+           [](double x, double) { return fast_pow5(x); }, sink);
+    report("log", "abs", 1e-9, 1,
+           [](double x, double) { return std::log(x); },
+           [](double x, double) { return fast_log(x); }, sink);
+    report("sqrt", "rel", 1e-6, 100,
+           [](double x, double) { return std::sqrt(x); },
+           [](double x, double) { return fast_sqrt(x); }, sink);
+    report("sin", "abs", -1000, 1000,
+           [](double x, double) { return std::sin(x); },
+           [](double x, double) { return fast_sin(x); }, sink);
+
+    std::printf("(checksum %g)\n", sink);
+}
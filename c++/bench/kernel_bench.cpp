@@ -0,0 +1,213 @@
+// Microbenchmarks of the ray tracer's inner kernels, to validate an optimization of one in isolation.
+//
+// Every kernel runs over a corpus generated from a fixed seed (rays, points, hit records), so runs are
+// comparable.  Each is warmed up, then timed over a number of samples of about 10ms each, and the
+// median ns per call is reported with the fastest sample, the spread (median absolute deviation as
+// a percentage of the median) and the throughput in millions of calls per second.
+//
+//   make bench_kernels               (from c++/src, which earthmap.png is found from)
+//   ../out/kernel_bench sphere bvh   only the kernels whose names contain one of the arguments
+
+#include "rtweekend.h"
+#include "bvh.h"
+#include "color.h"
+#include "hittable_list.h"
+#include "material.h"
+#include "perlin.h"
+#include "quad.h"
+#include "sphere.h"
+#include "texture.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+static const int corpus_size = 4096;
+static const int samples = 21;
+static const double warmup_seconds = 0.05;
+static const double sample_seconds = 0.01;
+
+// The fixed seed corpora the kernels run over
+struct corpus {
+    std::mt19937 rng{12345};
+    std::vector<ray> rays;          // from a shell of radius 5 towards [-1.5,1.5]^3, about half hit a unit primitive
+    std::vector<ray> scene_rays;    // from around the random_spheres camera into its field of spheres
+    std::vector<point3> points;     // in [0,10)^3
+    std::vector<hit_record> hits;   // on a unit sphere, seen from outside
+    std::vector<color> colors;      // in [0,1.5)^3, so some clamp
+
+    double uniform(double lo, double hi) { return lo + (hi - lo) * (rng() / 4294967296.0); }
+    vec3 uniform_vec(double lo, double hi) { return vec3(uniform(lo, hi), uniform(lo, hi), uniform(lo, hi)); }
+
+    corpus() {
+        for (int n = 0; n < corpus_size; n++) {
+            point3 origin = 5 * unit_vector(uniform_vec(-1, 1));
+            rays.push_back(ray(origin, uniform_vec(-1.5, 1.5) - origin));
+
+            point3 eye = point3(13, 2, 3) + uniform_vec(-1, 1);
+            scene_rays.push_back(ray(eye, point3(uniform(-11, 11), uniform(0, 1), uniform(-11, 11)) - eye));
+
+            points.push_back(uniform_vec(0, 10));
+            colors.push_back(uniform_vec(0, 1.5));
+
+            hit_record rec;
+            vec3 normal = unit_vector(uniform_vec(-1, 1));
+            rec.p = normal;
+            rec.t = 1;
+            rec.u = uniform(0, 1);
+            rec.v = uniform(0, 1);
+            rec.uv_width = 0;
+            rec.set_face_normal(ray(2 * normal, -normal), normal);
+            hits.push_back(rec);
+        }
+    }
+};
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Runs f over the corpus `passes` times, the returned values are summed so the calls can't be optimised away
+static double time_passes(const std::function<double(int)>& f, int passes, double& sink) {
+    auto start = std::chrono::steady_clock::now();
+    double sum = 0;
+    for (int pass = 0; pass < passes; pass++) {
+        for (int i = 0; i < corpus_size; i++) sum += f(i);
+    }
+    double seconds = seconds_since(start);
+    sink += sum;
+    return seconds;
+}
+
+static void run_kernel(const char* name, const std::function<double(int)>& f, double& sink) {
+    // warm up the caches and branch predictors, and size the samples from how long a pass takes
+    auto warmup_start = std::chrono::steady_clock::now();
+    int warmup_passes = 0;
+    while (seconds_since(warmup_start) < warmup_seconds) {
+        time_passes(f, 1, sink);
+        warmup_passes++;
+    }
+    double pass_seconds = seconds_since(warmup_start) / warmup_passes;
+    int passes = std::max(1, static_cast<int>(sample_seconds / pass_seconds));
+
+    std::vector<double> ns(samples);
+    for (int s = 0; s < samples; s++) {
+        ns[s] = 1e9 * time_passes(f, passes, sink) / (static_cast<double>(passes) * corpus_size);
+    }
+
+    std::sort(ns.begin(), ns.end());
+    double median = ns[samples / 2];
+
+    std::vector<double> deviation(samples);
+    for (int s = 0; s < samples; s++) deviation[s] = std::fabs(ns[s] - median);
+    std::sort(deviation.begin(), deviation.end());
+    double spread = 100 * deviation[samples / 2] / median;
+
+    std::printf("%-24s %9.2f ns/op  (min %9.2f, +-%4.1f%%)  %9.2f Mops/s\n",
+                name, median, ns[0], spread, 1e3 / median);
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<std::string> filters(argv + 1, argv + argc);
+    auto wanted = [&filters](const char* name) {
+        if (filters.empty()) return true;
+        for (const auto& f : filters) {
+            if (std::string(name).find(f) != std::string::npos) return true;
+        }
+        return false;
+    };
+
+    seed_random(1);
+    corpus c;
+    double sink = 0;
+
+    auto matte = make_shared<lambertian>(color(0.5, 0.5, 0.5));
+    sphere unit_sphere(point3(0, 0, 0), 1, matte);
+    quad unit_quad(point3(-1, -1, 0), vec3(2, 0, 0), vec3(0, 2, 0), matte);
+    aabb unit_box(point3(-1, -1, -1), point3(1, 1, 1));
+
+    // a random_spheres like field of 484 small spheres on a ground sphere as a BVH, and the first 32 as a flat list
+    hittable_list field, field_list;
+    field.add(make_shared<sphere>(point3(0, -1000, 0), 1000, matte));
+    for (int a = -11; a < 11; a++) {
+        for (int b = -11; b < 11; b++) {
+            field.add(make_shared<sphere>(point3(a + 0.9*c.uniform(0, 1), 0.2, b + 0.9*c.uniform(0, 1)), 0.2, matte));
+        }
+    }
+    for (int n = 0; n < 32; n++) field_list.add(field.objects[n]);
+    bvh_node field_bvh(field);
+
+    perlin noise(0);
+    image_texture earth_texture("earthmap.png");
+    lambertian diffuse(color(0.5, 0.5, 0.5));
+    metal fuzzy_metal(color(0.8, 0.6, 0.2), 0.3);
+    dielectric glass(1.5);
+
+    struct kernel {
+        const char* name;
+        std::function<double(int)> f;
+    };
+    std::vector<kernel> kernels = {
+        {"sphere::hit", [&](int i) {
+            hit_record rec;
+            return unit_sphere.hit(c.rays[i], interval(0.001, infinity), rec) ? rec.t : 0.0;
+        }},
+        {"quad::hit", [&](int i) {
+            hit_record rec;
+            return unit_quad.hit(c.rays[i], interval(0.001, infinity), rec) ? rec.t : 0.0;
+        }},
+        {"aabb::hit", [&](int i) {
+            interval ray_t(0.001, infinity);
+            return unit_box.hit(c.rays[i], ray_t) ? 1.0 : 0.0;
+        }},
+        {"bvh_node::hit (485)", [&](int i) {
+            hit_record rec;
+            return field_bvh.hit(c.scene_rays[i], interval(0.001, infinity), rec) ? rec.t : 0.0;
+        }},
+        {"hittable_list::hit (32)", [&](int i) {
+            hit_record rec;
+            return field_list.hit(c.scene_rays[i], interval(0.001, infinity), rec) ? rec.t : 0.0;
+        }},
+        {"perlin::turb", [&](int i) {
+            return noise.turb(c.points[i]);
+        }},
+        {"image_texture::value", [&](int i) {
+            return earth_texture.value(c.hits[i].u, c.hits[i].v, c.hits[i].p).x();
+        }},
+        {"lambertian::scatter", [&](int i) {
+            color attenuation;
+            ray scattered;
+            diffuse.scatter(c.rays[i], c.hits[i], attenuation, scattered);
+            return scattered.direction().x();
+        }},
+        {"metal::scatter", [&](int i) {
+            color attenuation;
+            ray scattered;
+            fuzzy_metal.scatter(c.rays[i], c.hits[i], attenuation, scattered);
+            return scattered.direction().x();
+        }},
+        {"dielectric::scatter", [&](int i) {
+            color attenuation;
+            ray scattered;
+            glass.scatter(c.rays[i], c.hits[i], attenuation, scattered);
+            return scattered.direction().x();
+        }},
+        {"write_color", [&](int i) {
+            static std::ostringstream out;
+            if (i == 0) out.str("");
+            write_color(out, c.colors[i], 1);
+            return 0.0;
+        }},
+    };
+
+    for (const auto& k : kernels) {
+        if (wanted(k.name)) run_kernel(k.name, k.f, sink);
+    }
+
+    std::printf("(checksum %g)\n", sink);
+}
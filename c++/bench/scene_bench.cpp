@@ -0,0 +1,216 @@
+// Render benchmark over the built in scenes.
+//
+// Every scene in scenes.h is built and rendered at the same resolution, samples per pixel and seed,
+// and the scene build time, BVH build time, render time, rays per second and peak resident memory
+// are written to stdout as JSON.  With --baseline, each scene is compared against the results in
+// that file and the exit status is 1 when any of them is slower or bigger than the thresholds allow.
+//
+//   make bench                      (from c++/src) compare against the parent commit, run here
+//   make bench BENCH_BASE=<commit>  compare against another commit
+//
+// Timings and memory only compare between runs on the same machine, so the baseline is made by
+// building this benchmark from the base commit and running it here.  bench/baseline.json is one
+// machine's results, kept as a record of the numbers the benchmark gives: it is not a gate and
+// other machines should not be compared against it.
+//
+// Options: --width N  --spp N  --seed N  --repeats N  --baseline FILE  --max-slowdown F  --max-rss-growth F
+//
+// Each scene runs in its own forked process, so the image, texture and noise caches a scene fills
+// don't make later scenes look cheaper to build, and peak RSS is that scene's alone.
+
+#include "scenes.h"
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+
+struct bench_config {
+    int width = 160;
+    int samples_per_pixel = 8;
+    unsigned int seed = 1;
+    int repeats = 3;               // each scene's fastest run is reported, the others are timing noise
+    std::string baseline;
+    double max_slowdown = 0.10;    // fail when Mrays/s drops by more than this fraction of the baseline
+    double max_rss_growth = 0.20;  // or peak RSS grows by more than this fraction
+};
+
+struct bench_result {
+    double mrays_per_s = 0;
+    long peak_rss_kb = 0;
+};
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Builds and renders one scene, returning its JSON object
+static std::string run_scene(const named_scene& entry, const bench_config& config) {
+    std::clog.rdbuf(nullptr);  // no progress or timing text from the camera
+
+    seed_random(config.seed);
+    auto build_start = std::chrono::steady_clock::now();
+    scene s = entry.build();
+    double build_s = seconds_since(build_start);
+    double bvh_s = bvh_node::build_seconds();
+
+    s.cam.image_width = config.width;
+    s.cam.samples_per_pixel = config.samples_per_pixel;
+    s.cam.write_image = false;
+
+    seed_random(config.seed);
+    auto render_start = std::chrono::steady_clock::now();
+    s.render();
+    double render_s = seconds_since(render_start);
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);  // ru_maxrss is in KiB on Linux
+
+    unsigned long long rays = s.cam.rays_traced();
+    char json[512];
+    std::snprintf(json, sizeof(json),
+                  "{\"scene\": \"%s\", \"scene_build_s\": %.6f, \"bvh_build_s\": %.6f, \"render_s\": %.6f, "
+                  "\"rays\": %llu, \"mrays_per_s\": %.4f, \"peak_rss_kb\": %ld}",
+                  entry.name, build_s, bvh_s, render_s, rays, rays / render_s / 1e6, usage.ru_maxrss);
+    return json;
+}
+
+// run_scene in a child process, its JSON comes back through a pipe
+static std::string run_isolated(const named_scene& entry, const bench_config& config) {
+    int fds[2];
+    if (pipe(fds) != 0) return "";
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return "";
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        std::string json = run_scene(entry, config);
+        ssize_t written = write(fds[1], json.data(), json.size());
+        _exit(written == static_cast<ssize_t>(json.size()) ? 0 : 1);
+    }
+    close(fds[1]);
+
+    std::string json;
+    char buffer[512];
+    ssize_t n;
+    while ((n = read(fds[0], buffer, sizeof(buffer))) > 0) json.append(buffer, n);
+    close(fds[0]);
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) return "";
+    return json;
+}
+
+// The number after "key": in a flat JSON object, or 0 when it's missing
+static double json_number(const std::string& json, const std::string& key) {
+    size_t at = json.find("\"" + key + "\":");
+    return at == std::string::npos ? 0 : std::atof(json.c_str() + at + key.size() + 3);
+}
+
+static std::string json_string(const std::string& json, const std::string& key) {
+    size_t at = json.find("\"" + key + "\": \"");
+    if (at == std::string::npos) return "";
+    at += key.size() + 5;
+    return json.substr(at, json.find('"', at) - at);
+}
+
+// Results by scene name from a file this program wrote, one scene object per line
+static std::map<std::string, bench_result> read_baseline(const std::string& filename) {
+    std::map<std::string, bench_result> results;
+    std::ifstream in(filename);
+    if (!in) {
+        std::cerr << "ERROR: Could not read the baseline '" << filename << "'.\n";
+        return results;
+    }
+
+    std::string line;
+    while (std::getline(in, line)) {
+        std::string name = json_string(line, "scene");
+        if (name.empty()) continue;
+        results[name].mrays_per_s = json_number(line, "mrays_per_s");
+        results[name].peak_rss_kb = static_cast<long>(json_number(line, "peak_rss_kb"));
+    }
+    return results;
+}
+
+static bool parse_args(int argc, char* argv[], bench_config& config) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "ERROR: Missing value for '" << arg << "'.\n";
+            return false;
+        }
+        const char* value = argv[++i];
+
+        if (arg == "--width") config.width = std::atoi(value);
+        else if (arg == "--spp") config.samples_per_pixel = std::atoi(value);
+        else if (arg == "--seed") config.seed = static_cast<unsigned int>(std::atoi(value));
+        else if (arg == "--repeats") config.repeats = std::atoi(value);
+        else if (arg == "--baseline") config.baseline = value;
+        else if (arg == "--max-slowdown") config.max_slowdown = std::atof(value);
+        else if (arg == "--max-rss-growth") config.max_rss_growth = std::atof(value);
+        else {
+            std::cerr << "ERROR: Unknown option '" << arg << "'.\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    bench_config config;
+    if (!parse_args(argc, argv, config)) return 2;
+
+    std::map<std::string, bench_result> baseline;
+    if (!config.baseline.empty()) baseline = read_baseline(config.baseline);
+
+    std::cout << "{\n  \"width\": " << config.width << ", \"spp\": " << config.samples_per_pixel
+              << ", \"seed\": " << config.seed << ", \"repeats\": " << config.repeats << ",\n  \"scenes\": [\n";
+
+    auto scenes = builtin_scenes();
+    int regressions = 0;
+    for (size_t n = 0; n < scenes.size(); n++) {
+        std::string json;
+        for (int r = 0; r < config.repeats; r++) {
+            std::string run = run_isolated(scenes[n], config);
+            if (run.empty()) {
+                json.clear();
+                break;
+            }
+            if (json.empty() || json_number(run, "mrays_per_s") > json_number(json, "mrays_per_s")) json = run;
+        }
+        if (json.empty()) {
+            std::cerr << "ERROR: Scene '" << scenes[n].name << "' failed.\n";
+            regressions++;
+            continue;
+        }
+        std::cout << "    " << json << (n + 1 < scenes.size() ? ",\n" : "\n") << std::flush;
+
+        auto base = baseline.find(scenes[n].name);
+        if (base == baseline.end()) continue;
+
+        double speed = json_number(json, "mrays_per_s") / base->second.mrays_per_s;
+        double rss = json_number(json, "peak_rss_kb") / base->second.peak_rss_kb;
+        bool slower = speed < 1 - config.max_slowdown;
+        bool bigger = rss > 1 + config.max_rss_growth;
+
+        std::cerr << scenes[n].name << ": " << speed << "x baseline Mrays/s, " << rss << "x baseline peak RSS"
+                  << (slower ? "  REGRESSION (speed)" : "") << (bigger ? "  REGRESSION (memory)" : "") << '\n';
+        if (slower || bigger) regressions++;
+    }
+
+    std::cout << "  ]\n}\n";
+    return regressions > 0 ? 1 : 0;
+}
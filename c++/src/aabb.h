@@ -2,6 +2,7 @@
 #define AABB_H
 
 #include "rtweekend.h"
+#include "stats.h"
 
 
 class aabb {
@@ -25,7 +26,7 @@ public:
     }
 
     aabb pad() {
-        double delta = 0.0001;
+        real delta = 0.0001;
         interval new_x = (x.size() >= delta) ? x : x.expand(delta);
         interval new_y = (y.size() >= delta) ? y : y.expand(delta);
         interval new_z = (z.size() >= delta) ? z : z.expand(delta);
@@ -40,25 +41,31 @@ public:
     }
 
     bool hit(const ray& r, interval& ray_t) const {
-        for (int a = 0; a < 3; a++) {
-            double invD = 1 / r.direction()[a];
-            double orig = r.origin()[a];
-
-            double t0 = (axis(a).min - orig) * invD;
-            double t1 = (axis(a).max - orig) * invD;
-
-            if (invD < 0) {
-                std::swap(t0, t1);
-            }
-
-            if (t0 > ray_t.min) ray_t.min = t0;
-            if (t1 < ray_t.max) ray_t.max = t1;
-
-            if (ray_t.max <= ray_t.min) {
-                return false;
-            }
-        }
-        return true;
+        RTW_STAT(aabb_tests);
+        // The ray's sign picks the near and far plane of each slab, so there's no swap or divide.
+        // A zero direction component gives infinite distances, or NaN when the origin lies on the
+        // slab's plane, and the compare-select min/max below keep the current bound for a NaN.
+        const point3& orig = r.origin();
+        const vec3& invD = r.inv_direction();
+
+        real tx0 = ((r.sign(0) ? x.max : x.min) - orig.x()) * invD.x();
+        real tx1 = ((r.sign(0) ? x.min : x.max) - orig.x()) * invD.x();
+        real ty0 = ((r.sign(1) ? y.max : y.min) - orig.y()) * invD.y();
+        real ty1 = ((r.sign(1) ? y.min : y.max) - orig.y()) * invD.y();
+        real tz0 = ((r.sign(2) ? z.max : z.min) - orig.z()) * invD.z();
+        real tz1 = ((r.sign(2) ? z.min : z.max) - orig.z()) * invD.z();
+
+        real t_min = ray_t.min, t_max = ray_t.max;
+        t_min = tx0 > t_min ? tx0 : t_min;
+        t_min = ty0 > t_min ? ty0 : t_min;
+        t_min = tz0 > t_min ? tz0 : t_min;
+        t_max = tx1 < t_max ? tx1 : t_max;
+        t_max = ty1 < t_max ? ty1 : t_max;
+        t_max = tz1 < t_max ? tz1 : t_max;
+
+        ray_t.min = t_min;
+        ray_t.max = t_max;
+        return t_min < t_max;
     }
 };
 
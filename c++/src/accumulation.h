@@ -0,0 +1,129 @@
+#ifndef ACCUMULATION_H
+#define ACCUMULATION_H
+
+// Per pixel sums of a render's samples, which can be saved part way through, resumed and added to
+// sums rendered elsewhere.
+//
+// An accumulation file (".rtwacc") is a 32 byte header, then for each pixel, rows top to bottom, the
+// sum of its samples' colours, the sum of their squared luminances and how many there were.  Sums of
+// independent renders of the same image add up to the sums of one render with all their samples.
+// The header's key identifies the image (see camera::checkpoint_key), so sums of another view or
+// scene are never added in.
+
+#include "rtweekend.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+struct accumulated_pixel {
+    double sum[3] = {0, 0, 0};
+    double luminance_sq = 0;
+    uint64_t samples = 0;
+
+    void add(const color& pixel_sum, double pixel_luminance_sq, uint64_t n) {
+        for (int c = 0; c < 3; c++) sum[c] += pixel_sum[c];
+        luminance_sq += pixel_luminance_sq;
+        samples += n;
+    }
+
+    color mean() const {
+        if (samples == 0) return color(0, 0, 0);
+        return color(sum[0], sum[1], sum[2]) / static_cast<real>(samples);
+    }
+
+    // Variance of the mean luminance
+    double variance() const {
+        if (samples == 0) return 0;
+        double n = static_cast<double>(samples);
+        double mean_luminance = luminance(mean());
+        return fmax(0.0, luminance_sq / n - mean_luminance*mean_luminance) / n;
+    }
+};
+
+class accumulation_buffer {
+public:
+    int width = 0, height = 0;
+    uint64_t key = 0;  // what was rendered: the camera's settings and the scene's source
+    std::vector<accumulated_pixel> pixels;
+
+    accumulation_buffer() {}
+    accumulation_buffer(int width, int height)
+        : width(width), height(height), pixels(static_cast<size_t>(width) * height) {}
+
+    accumulated_pixel& at(int i, int j) { return pixels[static_cast<size_t>(j)*width + i]; }
+
+    uint64_t total_samples() const {
+        uint64_t n = 0;
+        for (const auto& p : pixels) n += p.samples;
+        return n;
+    }
+
+    // Adds another render of the same image, false when the sizes or keys differ
+    bool add(const accumulation_buffer& other) {
+        if (other.width != width || other.height != height || other.key != key) return false;
+        for (size_t p = 0; p < pixels.size(); p++) {
+            const accumulated_pixel& o = other.pixels[p];
+            for (int c = 0; c < 3; c++) pixels[p].sum[c] += o.sum[c];
+            pixels[p].luminance_sq += o.luminance_sq;
+            pixels[p].samples += o.samples;
+        }
+        return true;
+    }
+
+    bool read(const std::string& filename) {
+        std::FILE* f = std::fopen(filename.c_str(), "rb");
+        if (!f) return false;
+
+        header h;
+        bool ok = std::fread(&h, sizeof(h), 1, f) == 1 && std::memcmp(h.magic, "RTWACC\0\0", 8) == 0
+               && h.version == format_version && h.width > 0 && h.height > 0;
+        if (ok) {
+            *this = accumulation_buffer(static_cast<int>(h.width), static_cast<int>(h.height));
+            key = h.key;
+            ok = std::fread(pixels.data(), sizeof(accumulated_pixel), pixels.size(), f) == pixels.size();
+        }
+        std::fclose(f);
+        return ok;
+    }
+
+    // Written under another name and renamed, so a crash while writing leaves the last good file
+    bool write(const std::string& filename) const {
+        header h;
+        std::memcpy(h.magic, "RTWACC\0\0", 8);
+        h.version = format_version;
+        h.width = static_cast<uint32_t>(width);
+        h.height = static_cast<uint32_t>(height);
+        h.reserved = 0;
+        h.key = key;
+
+        std::string temporary = filename + ".tmp";
+        std::FILE* out = std::fopen(temporary.c_str(), "wb");
+        if (!out) return false;
+        bool ok = std::fwrite(&h, sizeof(h), 1, out) == 1
+               && std::fwrite(pixels.data(), sizeof(accumulated_pixel), pixels.size(), out) == pixels.size();
+        ok = (std::fclose(out) == 0) && ok;
+        ok = ok && std::rename(temporary.c_str(), filename.c_str()) == 0;
+        if (!ok) std::remove(temporary.c_str());
+        return ok;
+    }
+
+private:
+    static const uint32_t format_version = 2;  // 2 added the key
+
+    struct header {
+        char magic[8];
+        uint32_t version;
+        uint32_t width, height;
+        uint32_t reserved;
+        uint64_t key;
+    };
+
+    static_assert(sizeof(header) == 32, "the header is 32 bytes in the file");
+    static_assert(sizeof(accumulated_pixel) == 40, "pixels are 40 bytes in the file");
+};
+
+#endif
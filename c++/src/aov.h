@@ -0,0 +1,124 @@
+#ifndef AOV_H
+#define AOV_H
+
+// Arbitrary Output Variables: per pixel data about the first hit of each camera
+// ray, gathered alongside the beauty image for denoising and compositing
+
+#include "rtweekend.h"
+#include "pfm.h"
+
+#include <string>
+#include <vector>
+
+// What a single camera ray saw at its first hit
+class aov_sample {
+public:
+    bool hit = false;
+    color albedo;         // surface albedo (or the background seen when nothing was hit)
+    vec3 normal;          // shading normal
+    double depth = 0;     // distance along the ray
+    int material_id = -1;
+};
+
+class aov_buffers {
+public:
+    void resize(int w, int h) {
+        width = w;
+        height = h;
+        size_t n = static_cast<size_t>(w) * h;
+        albedo_sum.assign(n, color(0,0,0));
+        normal_sum.assign(n, vec3(0,0,0));
+        depth_sum.assign(n, 0.0);
+        hits.assign(n, 0);
+        samples.assign(n, 0);
+        material_ids.assign(n, -1);
+    }
+
+    void add(int i, int j, const aov_sample& s) {
+        size_t n = index(i, j);
+        if (samples[n] == 0) material_ids[n] = s.material_id;  // ids can't be averaged, keep the first sample's
+        samples[n]++;
+        albedo_sum[n] += s.albedo;
+
+        if (s.hit) {
+            hits[n]++;
+            normal_sum[n] += s.normal;
+            depth_sum[n] += s.depth;
+        }
+    }
+
+    int samples_taken(int i, int j) const { return samples[index(i, j)]; }
+    int material_id(int i, int j) const { return material_ids[index(i, j)]; }
+
+    color albedo(int i, int j) const {
+        size_t n = index(i, j);
+        return samples[n] ? albedo_sum[n] / samples[n] : color(0,0,0);
+    }
+
+    vec3 normal(int i, int j) const {
+        // averaged normals are not renormalized, their length says how much the normals disagree
+        size_t n = index(i, j);
+        return hits[n] ? normal_sum[n] / hits[n] : vec3(0,0,0);
+    }
+
+    double depth(int i, int j) const {
+        // mean distance of the samples that hit something, 0 when none did
+        size_t n = index(i, j);
+        return hits[n] ? depth_sum[n] / hits[n] : 0.0;
+    }
+
+    // Writes <prefix>_albedo.pfm, _normal.pfm, _depth.pfm, _material.pfm and _samples.pfm
+    bool write(const std::string& prefix) const {
+        std::vector<float> rgb(static_cast<size_t>(width) * height * 3);
+        std::vector<float> grey(static_cast<size_t>(width) * height);
+        bool ok = true;
+
+        fill(rgb, [this](int i, int j) { return albedo(i, j); });
+        ok = write_pfm(prefix + "_albedo.pfm", rgb.data(), width, height) && ok;
+
+        fill(rgb, [this](int i, int j) { return normal(i, j); });
+        ok = write_pfm(prefix + "_normal.pfm", rgb.data(), width, height) && ok;
+
+        fill(grey, [this](int i, int j) { return depth(i, j); });
+        ok = write_pfm(prefix + "_depth.pfm", grey.data(), width, height, 1) && ok;
+
+        fill(grey, [this](int i, int j) { return static_cast<double>(material_id(i, j)); });
+        ok = write_pfm(prefix + "_material.pfm", grey.data(), width, height, 1) && ok;
+
+        fill(grey, [this](int i, int j) { return static_cast<double>(samples_taken(i, j)); });
+        ok = write_pfm(prefix + "_samples.pfm", grey.data(), width, height, 1) && ok;
+
+        return ok;
+    }
+
+private:
+    int width = 0, height = 0;
+    std::vector<color> albedo_sum;
+    std::vector<vec3> normal_sum;
+    std::vector<double> depth_sum;
+    std::vector<int> hits;
+    std::vector<int> samples;
+    std::vector<int> material_ids;
+
+    size_t index(int i, int j) const { return static_cast<size_t>(j) * width + i; }
+
+    template <typename F>
+    void fill(std::vector<float>& out, F f) const {
+        int channels = static_cast<int>(out.size() / (static_cast<size_t>(width) * height));
+        for (int j = 0; j < height; j++) {
+            for (int i = 0; i < width; i++) {
+                write_channels(&out[index(i, j) * channels], channels, f(i, j));
+            }
+        }
+    }
+
+    static void write_channels(float* dst, int channels, const vec3& v) {
+        for (int c = 0; c < channels; c++) dst[c] = static_cast<float>(v[c]);
+    }
+
+    static void write_channels(float* dst, int channels, double x) {
+        dst[0] = static_cast<float>(x);
+    }
+};
+
+#endif
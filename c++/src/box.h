@@ -0,0 +1,159 @@
+#ifndef BOX_H
+#define BOX_H
+
+#include "rtweekend.h"
+#include "hittable.h"
+#include "material.h"
+#include "stats.h"
+
+#include <cmath>
+
+// Axis aligned box, intersected with a single slab test rather than as six separate quads.
+// Each face gets the (u,v) mapping and outward normal of the quad the box used to be built from.
+class box : public hittable {
+public:
+    // The box with opposite vertices a & b
+    box(const point3& a, const point3& b, shared_ptr<material> mat) : bounds(a, b), mat(mat) {
+        bbox = aabb(a, b).pad();
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        RTW_STAT(primitive_tests[stat_box]);
+        // entry and exit distances through the three slabs, and the axis of the face crossed at each
+        real t_enter = -infinity, t_exit = infinity;
+        int enter_axis = 0, exit_axis = 0;
+
+        for (int a = 0; a < 3; a++) {
+            real invD = r.inv_direction()[a];
+            real orig = r.origin()[a];
+
+            real t0 = (bounds.axis(a).min - orig) * invD;
+            real t1 = (bounds.axis(a).max - orig) * invD;
+            if (invD < 0) std::swap(t0, t1);
+
+            if (t0 > t_enter) { t_enter = t0; enter_axis = a; }
+            if (t1 < t_exit)  { t_exit = t1;  exit_axis = a; }
+        }
+        if (t_exit < t_enter) return false;
+
+        // the entry face, or the exit face when the ray starts inside (as when bounding a medium)
+        bool entering = ray_t.contains(t_enter);
+        if (!entering && !ray_t.contains(t_exit)) return false;
+
+        real t = entering ? t_enter : t_exit;
+        int axis = entering ? enter_axis : exit_axis;
+
+        // the entry face faces against the ray, the exit face along it
+        real d = r.direction()[axis];
+        bool max_side = entering ? (d < 0) : (d > 0);
+
+        rec.t = t;
+        rec.p = r.at(t);
+        face_uv(axis, max_side, rec.p, rec.u, rec.v);
+        rec.uv_width = r.spread() * t * r.direction().length() / face_size(axis);
+        rec.mat = mat;
+
+        vec3 outward_normal(0, 0, 0);
+        outward_normal[axis] = max_side ? 1 : -1;
+        rec.set_face_normal(r, outward_normal);
+
+        return true;
+    }
+
+    // As a light the box is sampled uniformly over its surface.  A direction from outside crosses it
+    // twice, and either crossing could have been the point sampled, so both add to its density
+    double pdf_value(const point3& origin, const vec3& direction) const override {
+        ray r(origin, direction);
+        real t_enter = -infinity, t_exit = infinity;
+        int enter_axis = 0, exit_axis = 0;
+        for (int a = 0; a < 3; a++) {
+            real invD = r.inv_direction()[a];
+            real t0 = (bounds.axis(a).min - origin[a]) * invD;
+            real t1 = (bounds.axis(a).max - origin[a]) * invD;
+            if (invD < 0) std::swap(t0, t1);
+            if (t0 > t_enter) { t_enter = t0; enter_axis = a; }
+            if (t1 < t_exit)  { t_exit = t1;  exit_axis = a; }
+        }
+        if (t_exit < t_enter) return 0;
+
+        double pdf = 0;
+        if (t_enter > r.min_t()) pdf += crossing_pdf(direction, t_enter, enter_axis);
+        if (t_exit > r.min_t()) pdf += crossing_pdf(direction, t_exit, exit_axis);
+        return pdf;
+    }
+
+    vec3 random(const point3& origin) const override {
+        // a face with probability proportional to its area, then a point on it
+        double pick = random_double() * surface_area();
+        int axis = 0;
+        while (axis < 2 && pick >= 2 * face_area(axis)) pick -= 2 * face_area(axis++);
+        bool max_side = pick >= face_area(axis);
+
+        point3 p;
+        p[axis] = max_side ? bounds.axis(axis).max : bounds.axis(axis).min;
+        for (int a = 1; a < 3; a++) {
+            const interval& extent = bounds.axis((axis + a) % 3);
+            p[(axis + a) % 3] = extent.min + random_double() * extent.size();
+        }
+        return p - origin;
+    }
+
+    light_bounds emission_bounds() const override {
+        // diffuse_light emits out of every face, so in every direction
+        light_bounds lb;
+        lb.bounds = bbox;
+        point3 center((bounds.x.min + bounds.x.max) / 2, (bounds.y.min + bounds.y.max) / 2, (bounds.z.min + bounds.z.max) / 2);
+        lb.phi = pi * surface_area() * luminance(mat->emitted(0.5, 0.5, center));
+        return lb;
+    }
+
+private:
+    aabb bounds;  // exact extent, bbox is padded for the BVH
+    aabb bbox;
+    shared_ptr<material> mat;
+
+    static real fraction(const interval& extent, real x) {
+        return extent.size() > 0 ? (x - extent.min) / extent.size() : 0;
+    }
+
+    void face_uv(int axis, bool max_side, const point3& p, real& u, real& v) const {
+        real fx = fraction(bounds.x, p.x());
+        real fy = fraction(bounds.y, p.y());
+        real fz = fraction(bounds.z, p.z());
+
+        if (axis == 0) {         // right, left
+            u = max_side ? 1 - fz : fz;
+            v = fy;
+        } else if (axis == 1) {  // top, bottom
+            u = fx;
+            v = max_side ? 1 - fz : fz;
+        } else {                 // front, back
+            u = max_side ? fx : 1 - fx;
+            v = fy;
+        }
+    }
+
+    double face_area(int axis) const {
+        return bounds.axis((axis + 1) % 3).size() * bounds.axis((axis + 2) % 3).size();
+    }
+
+    double surface_area() const { return 2 * (face_area(0) + face_area(1) + face_area(2)); }
+
+    // Solid angle density of reaching the point t along direction on a face across axis
+    double crossing_pdf(const vec3& direction, real t, int axis) const {
+        double distance_squared = t * t * direction.length_squared();
+        double cosine = fabs(direction[axis]) / direction.length();
+        return cosine > 0 ? distance_squared / (cosine * surface_area()) : 0;
+    }
+
+    real face_size(int axis) const {
+        // square root of the face's area, its (u,v) square's side length
+        real a = bounds.axis((axis + 1) % 3).size();
+        real b = bounds.axis((axis + 2) % 3).size();
+        return fmax(sqrt(a * b), 1e-8);
+    }
+};
+
+#endif
@@ -4,16 +4,21 @@
 #include "rtweekend.h"
 #include "hittable.h"
 #include "hittable_list.h"
+#include "stats.h"
+#include "trace.h"
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 
 // Boudning Volume Hierarchy
 class bvh_node : public hittable {
 public:
-    bvh_node(const hittable_list& list) : bvh_node(list.objects, 0, list.objects.size()) {}
+    // The list is copied once and each node sorts its own range of the copy in place
+    bvh_node(hittable_list list) : bvh_node(list.objects, 0, list.objects.size()) {}
 
-    bvh_node(const std::vector<shared_ptr<hittable>>& src_objects, size_t start, size_t end) {
-        std::vector<shared_ptr<hittable>> objects = src_objects;
+    bvh_node(std::vector<shared_ptr<hittable>>& objects, size_t start, size_t end) {
+        build_timer timer;
 
         int axis = random_int(0, 2);
 
@@ -45,6 +50,7 @@ public:
     }
 
     bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        RTW_STAT(bvh_nodes_visited);
         if (!bbox.hit(r, ray_t)) {
             return false;
         }
@@ -55,26 +61,65 @@ public:
         return hit_left || hit_right;
     }
 
+    double transmittance(const ray& r, interval ray_t) const override {
+        RTW_STAT(bvh_nodes_visited);
+        if (!bbox.hit(r, ray_t)) return 1.0;
+
+        double T = left->transmittance(r, ray_t);
+        if (T <= 0 || right == left) return T;  // a node over one object has it on both sides
+        return T * right->transmittance(r, ray_t);
+    }
+
     aabb bounding_box() const override { return bbox; }
 
+    // Total time spent building trees so far, for the benchmarks (summed over threads when several
+    // build at once, as the render server's do)
+    static double build_seconds() { return build_nanoseconds().load() * 1e-9; }
+
 private:
+    friend class flat_bvh;  // flattens built trees for the cache (bvh_cache.h)
+
     shared_ptr<hittable> left;
     shared_ptr<hittable> right;
     aabb bbox;
 
-    static bool box_compare(const shared_ptr<hittable> a, const shared_ptr<hittable> b, int axis_index) {
+    // Adds the time the outermost constructor takes to build_seconds(), the recursive ones are part of
+    // it.  A tree is built on one thread, so the depth is counted per thread
+    struct build_timer {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        trace::span span{depth() == 0 ? "bvh_node build" : nullptr};
+
+        build_timer() { depth()++; }
+        ~build_timer() {
+            if (--depth() == 0) {
+                build_nanoseconds() += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+            }
+        }
+
+        static int& depth() {
+            static thread_local int d = 0;
+            return d;
+        }
+    };
+
+    static std::atomic<long long>& build_nanoseconds() {
+        static std::atomic<long long> nanoseconds(0);
+        return nanoseconds;
+    }
+
+    static bool box_compare(const shared_ptr<hittable>& a, const shared_ptr<hittable>& b, int axis_index) {
         return a->bounding_box().axis(axis_index).min < b->bounding_box().axis(axis_index).min;
     }
 
-    static bool box_x_compare(const shared_ptr<hittable> a, const shared_ptr<hittable> b) {
+    static bool box_x_compare(const shared_ptr<hittable>& a, const shared_ptr<hittable>& b) {
         return box_compare(a, b, 0);
     }
 
-    static bool box_y_compare(const shared_ptr<hittable> a, const shared_ptr<hittable> b) {
+    static bool box_y_compare(const shared_ptr<hittable>& a, const shared_ptr<hittable>& b) {
         return box_compare(a, b, 1);
     }
 
-    static bool box_z_compare(const shared_ptr<hittable> a, const shared_ptr<hittable> b) {
+    static bool box_z_compare(const shared_ptr<hittable>& a, const shared_ptr<hittable>& b) {
         return box_compare(a, b, 2);
     }
 };
@@ -0,0 +1,249 @@
+#ifndef BVH_CACHE_H
+#define BVH_CACHE_H
+
+// Built BVHs saved to disk, so a large static scene only pays for its tree once.
+//
+// A cache file (".rtwbvh") is a 32 byte header followed by the tree's nodes in depth first order,
+// root first, each a bounding box and two child references.  A reference is either another node's
+// index or, with its top bit set, an index into the list the tree was built over.  The header holds
+// a hash of that list's bounding boxes in order, which is all the tree depends on, so a file is
+// only used for the same objects in the same order (materials and textures can change freely).
+//
+// Later runs map the file and traverse its nodes in place, nothing is rebuilt or copied.  A file
+// that is missing, from another version or precision, for other objects or damaged is rebuilt and
+// written again.
+
+#include "rtweekend.h"
+#include "bvh.h"
+#include "hittable_list.h"
+#include "stats.h"
+#include "trace.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+// A BVH as an array of nodes over a list of objects, either built here or mapped from a cache file
+class flat_bvh : public hittable {
+public:
+    struct node {
+        aabb bbox;
+        uint32_t child[2];
+    };
+
+    static const uint32_t leaf = 0x80000000u;  // set in a child reference to an object
+
+    // Builds a bvh_node tree over the list and flattens it
+    explicit flat_bvh(const hittable_list& list) : objects(list.objects) {
+        std::unordered_map<const hittable*, uint32_t> index;
+        for (size_t i = 0; i < objects.size(); i++) index.emplace(objects[i].get(), static_cast<uint32_t>(i));
+
+        bvh_node tree(list);
+        owned.reserve(objects.size());
+        flatten(tree, index);
+        nodes = owned.data();
+        node_count = owned.size();
+    }
+
+    ~flat_bvh() {
+        if (mapping) munmap(mapping, mapping_size);
+    }
+
+    flat_bvh(const flat_bvh&) = delete;
+    flat_bvh& operator=(const flat_bvh&) = delete;
+
+    // The tree in a cache file for this list, or null when the file is missing or doesn't match
+    static shared_ptr<flat_bvh> load(const std::string& filename, const hittable_list& list) {
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0) return nullptr;
+
+        struct stat st;
+        void* data = MAP_FAILED;
+        if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(header)) {
+            data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+        close(fd);  // the mapping stays valid
+        if (data == MAP_FAILED) return nullptr;
+
+        auto bvh = shared_ptr<flat_bvh>(new flat_bvh(list.objects));
+        bvh->mapping = data;
+        bvh->mapping_size = static_cast<size_t>(st.st_size);
+
+        header h;
+        std::memcpy(&h, data, sizeof(h));
+        bool ok = std::memcmp(h.magic, magic(), 8) == 0 && h.version == format_version && h.real_size == sizeof(real)
+               && h.object_count == list.objects.size() && h.node_count > 0
+               && bvh->mapping_size == sizeof(header) + static_cast<size_t>(h.node_count) * sizeof(node)
+               && h.content_hash == content_hash(list);
+        if (!ok) return nullptr;
+
+        bvh->nodes = reinterpret_cast<const node*>(static_cast<const char*>(data) + sizeof(header));
+        bvh->node_count = h.node_count;
+        return bvh->valid() ? bvh : nullptr;
+    }
+
+    // Writes the tree as a cache file for the list it was built over
+    bool save(const std::string& filename) const {
+        header h;
+        std::memcpy(h.magic, magic(), 8);
+        h.version = format_version;
+        h.real_size = sizeof(real);
+        h.content_hash = content_hash(objects);
+        h.object_count = static_cast<uint32_t>(objects.size());
+        h.node_count = static_cast<uint32_t>(node_count);
+
+        // written under another name and renamed, so a reader never maps a partly written file
+        std::string temporary = filename + ".tmp";
+        std::FILE* out = std::fopen(temporary.c_str(), "wb");
+        if (!out) return false;
+        bool ok = std::fwrite(&h, sizeof(h), 1, out) == 1 && std::fwrite(nodes, sizeof(node), node_count, out) == node_count;
+        ok = (std::fclose(out) == 0) && ok;
+        ok = ok && std::rename(temporary.c_str(), filename.c_str()) == 0;
+        if (!ok) std::remove(temporary.c_str());
+        return ok;
+    }
+
+    size_t size() const { return node_count; }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        return hit_node(0, r, ray_t, rec);
+    }
+
+    double transmittance(const ray& r, interval ray_t) const override {
+        return transmittance_node(0, r, ray_t);
+    }
+
+    aabb bounding_box() const override { return nodes[0].bbox; }
+
+    static uint64_t content_hash(const hittable_list& list) { return content_hash(list.objects); }
+
+private:
+    static const uint32_t format_version = 1;
+
+    struct header {
+        char magic[8];
+        uint32_t version;
+        uint32_t real_size;  // sizeof(real), the boxes are stored as the renderer holds them
+        uint64_t content_hash;
+        uint32_t object_count;
+        uint32_t node_count;
+    };
+
+    static_assert(sizeof(header) == 32, "the header is 32 bytes in the file");
+    static_assert(std::is_trivially_copyable<node>::value, "nodes are mapped straight from the file");
+
+    std::vector<shared_ptr<hittable>> objects;
+    std::vector<node> owned;          // the nodes when built here
+    const node* nodes = nullptr;
+    size_t node_count = 0;
+    void* mapping = nullptr;          // the file when loaded from one
+    size_t mapping_size = 0;
+
+    explicit flat_bvh(const std::vector<shared_ptr<hittable>>& objects) : objects(objects) {}
+
+    static const char* magic() { return "RTWBVH\0\0"; }
+
+    // FNV-1a over the object count and every object's bounding box
+    static uint64_t content_hash(const std::vector<shared_ptr<hittable>>& objects) {
+        uint64_t hash = 14695981039346656037ull;
+        auto add = [&hash](const void* data, size_t bytes) {
+            const unsigned char* p = static_cast<const unsigned char*>(data);
+            for (size_t i = 0; i < bytes; i++) hash = (hash ^ p[i]) * 1099511628211ull;
+        };
+
+        uint64_t count = objects.size();
+        add(&count, sizeof(count));
+        for (const auto& object : objects) {
+            aabb box = object->bounding_box();
+            real bounds[6] = { box.x.min, box.x.max, box.y.min, box.y.max, box.z.min, box.z.max };
+            add(bounds, sizeof(bounds));
+        }
+        return hash;
+    }
+
+    // Appends the subtree's nodes and returns the reference to it
+    uint32_t flatten(const hittable& h, const std::unordered_map<const hittable*, uint32_t>& index) {
+        auto object = index.find(&h);
+        if (object != index.end()) return object->second | leaf;
+
+        // anything that isn't one of the objects is a node of the tree built over them
+        const bvh_node& tree = static_cast<const bvh_node&>(h);
+        uint32_t n = static_cast<uint32_t>(owned.size());
+        owned.push_back(node{tree.bbox, {0, 0}});
+        uint32_t left = flatten(*tree.left, index);
+        uint32_t right = flatten(*tree.right, index);
+        owned[n].child[0] = left;
+        owned[n].child[1] = right;
+        return n;
+    }
+
+    // Every reference is in range and every node's children come after it, so a traversal ends
+    bool valid() const {
+        for (size_t n = 0; n < node_count; n++) {
+            for (uint32_t c : nodes[n].child) {
+                bool ok = (c & leaf) ? (c & ~leaf) < objects.size() : (c > n && c < node_count);
+                if (!ok) return false;
+            }
+        }
+        return true;
+    }
+
+    bool hit_node(uint32_t n, const ray& r, interval ray_t, hit_record& rec) const {
+        RTW_STAT(bvh_nodes_visited);
+        const node& nd = nodes[n];
+        if (!nd.bbox.hit(r, ray_t)) return false;
+
+        bool hit_left = hit_child(nd.child[0], r, ray_t, rec);
+        if (nd.child[1] == nd.child[0]) return hit_left;  // a node over one object has it on both sides
+        bool hit_right = hit_child(nd.child[1], r, interval(ray_t.min, hit_left ? rec.t : ray_t.max), rec);
+        return hit_left || hit_right;
+    }
+
+    bool hit_child(uint32_t c, const ray& r, const interval& ray_t, hit_record& rec) const {
+        if (c & leaf) return objects[c & ~leaf]->hit(r, ray_t, rec);
+        return hit_node(c, r, ray_t, rec);
+    }
+
+    double transmittance_node(uint32_t n, const ray& r, interval ray_t) const {
+        RTW_STAT(bvh_nodes_visited);
+        const node& nd = nodes[n];
+        if (!nd.bbox.hit(r, ray_t)) return 1.0;
+
+        double T = transmittance_child(nd.child[0], r, ray_t);
+        if (T <= 0 || nd.child[1] == nd.child[0]) return T;
+        return T * transmittance_child(nd.child[1], r, ray_t);
+    }
+
+    double transmittance_child(uint32_t c, const ray& r, const interval& ray_t) const {
+        if (c & leaf) return objects[c & ~leaf]->transmittance(r, ray_t);
+        return transmittance_node(c, r, ray_t);
+    }
+};
+
+// A BVH over the list, mapped from the cache file when it matches, otherwise built and saved there
+inline shared_ptr<hittable> cached_bvh(const hittable_list& list, const std::string& filename) {
+    {
+        trace::span span("bvh cache load", filename);
+        if (auto bvh = flat_bvh::load(filename, list)) {
+            std::clog << "Mapped " << bvh->size() << " BVH nodes from " << filename << '\n';
+            return bvh;
+        }
+    }
+
+    auto bvh = make_shared<flat_bvh>(list);
+    if (bvh->save(filename)) std::clog << "Wrote " << bvh->size() << " BVH nodes to " << filename << '\n';
+    else std::cerr << "ERROR: Could not write the BVH cache '" << filename << "'.\n";
+    return bvh;
+}
+
+#endif
@@ -8,11 +8,25 @@ Will be responsible for:
 
 #include "rtweekend.h"
 
+#include "accumulation.h"
+#include "aov.h"
 #include "color.h"
+#include "denoiser.h"
+#include "environment.h"
 #include "hittable.h"
 #include "material.h"
+#include "stats.h"
+#include "texture_cache.h"
+#include "trace.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
 #include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
 
 class camera{
 public:
@@ -21,6 +35,7 @@ public:
     int    samples_per_pixel = 10;   // Number of rays (samples) sent out per pixel
     int    max_depth         = 10;   // Max number of times a single ray can bounce within the scene 
     color  background;               // Scene background color
+    shared_ptr<environment_map> environment;  // Image based lighting for rays that miss (replaces background when set)
 
     double vfov     = 90;              // Vertical view angle (field of view) (degrees)
     point3 lookfrom = point3(0,0,-1);  // Where the camera is looking from (where the sensor plane is?)
@@ -30,27 +45,86 @@ public:
     double defocus_angle = 0; // Variation angle to rays through each pixel
     double focus_dist = 10;   // Distance from camera lookfrom to perfect focus plane
 
-    void render(const hittable &world) {
-        initialize();
+    std::string aov_prefix;   // When set, also write <prefix>_{color,variance,albedo,normal,depth,material,samples}.pfm
 
-        std::cout << "P3\n";  // P3 := colors are in ASCII
-        std::cout << image_width << ' ' << image_height << '\n'; // Image width & height (i.e. # columns and rows)
-        std::cout << "255\n"; // 255 := Max color
+    bool denoise = false;            // Filter the image with the AOV guided a-trous denoiser before writing it
+    atrous_denoiser denoiser;        // Denoiser settings
+    std::string reference_image;     // Optional .pfm of the converged image to report RMSE against
 
-        for (int j=0; j < image_height; ++j) {  // write pixels out in rows
-            std::clog << "\rScanlines remaining: " << (image_height - j) << ' ' << std::flush;
-            for (int i=0; i<image_width; ++i) {  // each row is written out left to right
-                color pixel_color(0,0,0);
-                for (int sample = 0; sample < samples_per_pixel; ++sample) {
-                    ray r = get_ray(i, j);
-                    pixel_color += ray_color(r, max_depth, world);
-                }
-                write_color(std::cout, pixel_color, samples_per_pixel);
+    // Optional greyscale .pfm of what each pixel cost: its render time in seconds, or with
+    // cost_metric = bvh_nodes the BVH nodes its rays visited (needs a -DRTW_STATS build)
+    enum cost { pixel_time, bvh_nodes };
+    std::string cost_image;
+    cost cost_metric = pixel_time;
+
+    // When set, the per pixel sums are kept in this accumulation file (see accumulation.h): saved every
+    // checkpoint_interval seconds and at the end, and taken up again by the next render, which only
+    // adds the samples each pixel still needs to reach samples_per_pixel.  AOVs and the cost image
+    // only see the samples rendered since the last resume.  A checkpoint of another view or scene
+    // (another checkpoint_key) is refused
+    std::string checkpoint;
+    double checkpoint_interval = 60;
+    uint64_t scene_hash = 0;  // identifies what the world was built from, set by whoever builds it
+
+    // Identifies the image the per pixel sums are for: everything that changes what a sample sees,
+    // but not samples_per_pixel, which only says how many to take
+    uint64_t checkpoint_key() const {
+        double settings[] = { static_cast<double>(image_width), static_cast<double>(height()),
+                              static_cast<double>(max_depth), background.x(), background.y(), background.z(),
+                              vfov, lookfrom.x(), lookfrom.y(), lookfrom.z(), lookat.x(), lookat.y(), lookat.z(),
+                              vup.x(), vup.y(), vup.z(), defocus_angle, focus_dist };
+        return fnv1a(&scene_hash, sizeof(scene_hash), fnv1a(settings, sizeof(settings)));
+    }
+
+    bool write_image = true;  // Write the PPM to std::cout (the benchmarks only want the timings)
+
+    // Reset the -DRTW_STATS counters at the start and report them at the end.  Off for renders that
+    // share the process with others running at the same time (the render server's jobs), which
+    // would zero each other's counts
+    bool report_stats = true;
+
+    // Rays cast into the world by the last render (camera rays and every bounce)
+    unsigned long long rays_traced() const { return ray_count; }
+
+    // The last render's pixels (denoised when denoise is set), rows top to bottom
+    const std::vector<color>& rendered_image() const { return rendered; }
+
+    int height() const { return std::max(1, static_cast<int>(image_width / aspect_ratio)); }
+
+    // Adds the samples the pixels in columns [x0, x1) of rows [y0, y1) still need to reach
+    // samples_per_pixel to their sums in accumulated, an image sized buffer.  This is render()'s
+    // sampling for a piece of the image, the distributed renderer's workers render with it
+    void render_tile(const hittable& world, const hittable* lights, int x0, int y0, int x1, int y1,
+                     accumulation_buffer& accumulated) {
+        initialize();
+        for (int j = y0; j < y1; ++j) {
+            for (int i = x0; i < x1; ++i) {
+                sample_pixel(i, j, world, lights, accumulated.at(i, j), false);
             }
         }
+    }
 
-        std::clog << "\rDone :)                \n";
+    // Write the last render's pixels as a PPM
+    void write_ppm(std::ostream& out) const {
+        trace::span output_span("write PPM");
+        out << "P3\n";  // P3 := colors are in ASCII
+        out << image_width << ' ' << image_height << '\n'; // Image width & height (i.e. # columns and rows)
+        out << "255\n"; // 255 := Max color
+
+        for (const color& pixel_color : rendered) {  // rows top to bottom, each row left to right
+            write_color(out, pixel_color, 1);
+        }
+    }
+
+    void render(const hittable &world) {
+        render(world, nullptr);
+    }
+
+    // Render with next event estimation towards `lights` (e.g. a light_bvh, or a hittable_list to pick uniformly)
+    void render(const hittable &world, const hittable &lights) {
+        render(world, &lights);
     }
+
 private:
     int    image_height;    // Rendered image height
     point3 center;       // Camera center
@@ -60,10 +134,208 @@ private:
     vec3   u, v, w;        // Camera frame basis vectors
     vec3   defocus_disk_u; // Defocus disk horizontal radius
     vec3   defocus_disk_v; // Defocus disk vertical radius
+    double pixel_spread;   // Angle subtended by a pixel (radians)
+    aov_buffers aovs;      // First hit data per pixel (when aov_prefix is set)
+    mutable unsigned long long ray_count = 0;
+    std::vector<color> rendered;
+
+    void render(const hittable &world, const hittable *lights) {
+        initialize();
+        ray_count = 0;
+#ifdef RTW_STATS
+        if (report_stats) render_stats::reset();
+#endif
+
+        auto start = std::chrono::steady_clock::now();
+
+        bool collect_aovs = denoise || !aov_prefix.empty();
+        if (collect_aovs) aovs.resize(image_width, image_height);
+
+        std::vector<color> image(static_cast<size_t>(image_width) * image_height);
+        std::vector<double> variance(image.size());  // of each pixel's mean luminance
+
+        // per pixel sums are only kept for the whole image when they go to a checkpoint, otherwise
+        // each pixel's are summed on their own and only the image and variance are kept
+        accumulation_buffer accumulated;
+        bool checkpointing = resume(accumulated);
+        if (!checkpointing) accumulated = accumulation_buffer();  // one that couldn't be used
+        auto last_checkpoint = std::chrono::steady_clock::now();
+        std::vector<float> pixel_cost(cost_image.empty() ? 0 : image.size());
+
+        bool count_nodes = cost_metric == bvh_nodes;
+#ifndef RTW_STATS
+        if (!cost_image.empty() && count_nodes) {
+            std::cerr << "ERROR: Counting BVH nodes for the cost image needs a -DRTW_STATS build, using time instead.\n";
+            count_nodes = false;
+        }
+#endif
+
+        for (int j=0; j < image_height; ++j) {
+            trace::span row_span("scanline", std::string(), j);
+            std::clog << "\rScanlines remaining: " << (image_height - j) << ' ' << std::flush;
+            for (int i=0; i<image_width; ++i) {
+                auto pixel_start = std::chrono::steady_clock::now();
+                unsigned long long nodes_before = nodes_visited();
+
+                accumulated_pixel pixel_sums;
+                accumulated_pixel& sums = checkpointing ? accumulated.at(i, j) : pixel_sums;
+                sample_pixel(i, j, world, lights, sums, collect_aovs);
+                size_t p = static_cast<size_t>(j)*image_width + i;
+                image[p] = sums.mean();
+                variance[p] = sums.variance();
+
+                if (!pixel_cost.empty()) {
+                    std::chrono::duration<double> pixel_time = std::chrono::steady_clock::now() - pixel_start;
+                    pixel_cost[p] = static_cast<float>(count_nodes ? nodes_visited() - nodes_before : pixel_time.count());
+                }
+            }
+
+            std::chrono::duration<double> since_checkpoint = std::chrono::steady_clock::now() - last_checkpoint;
+            if (checkpointing && since_checkpoint.count() >= checkpoint_interval) {
+                save_checkpoint(accumulated);
+                last_checkpoint = std::chrono::steady_clock::now();
+            }
+        }
+        if (checkpointing) save_checkpoint(accumulated);
+
+        std::clog << "\rDone :)                \n";
+        report_time("Render", start);
+        if (texture_cache::global().lookups() > 0) texture_cache::global().report(std::clog);
+#ifdef RTW_STATS
+        if (report_stats) render_stats::report(std::clog);
+#endif
+
+        if (!pixel_cost.empty() && !write_pfm(cost_image, pixel_cost.data(), image_width, image_height, 1)) {
+            std::cerr << "ERROR: Could not write the cost image '" << cost_image << "'.\n";
+        }
+
+        if (!aov_prefix.empty()) {
+            trace::span aov_span("write AOVs");
+            write_aovs(image, variance);
+        }
+
+        std::vector<color> reference;
+        bool have_reference = load_reference(reference);
+        if (have_reference) std::clog << "RMSE vs reference: " << rmse(image, reference) << '\n';
+
+        if (denoise) {
+            trace::span denoise_span("denoise");
+            auto denoise_start = std::chrono::steady_clock::now();
+            image = denoiser.denoise(image, variance, aovs, image_width, image_height);
+            report_time("Denoise", denoise_start);
+            if (have_reference) std::clog << "RMSE vs reference (denoised): " << rmse(image, reference) << '\n';
+        }
+
+        rendered = std::move(image);
+        if (!write_image) return;
+
+        write_ppm(std::cout);
+    }
+
+    void sample_pixel(int i, int j, const hittable& world, const hittable* lights, accumulated_pixel& sums, bool collect_aovs) {
+        color pixel_color(0,0,0);
+        double luminance_sq = 0;
+        int samples = static_cast<int>(std::min<uint64_t>(sums.samples, samples_per_pixel));
+        for (int sample = samples; sample < samples_per_pixel; ++sample) {
+            ray r = get_ray(i, j);
+            aov_sample first_hit;
+            color sample_color = ray_color(r, max_depth, world, lights, collect_aovs ? &first_hit : nullptr);
+            pixel_color += sample_color;
+            luminance_sq += luminance(sample_color) * luminance(sample_color);
+            if (collect_aovs) aovs.add(i, j, first_hit);
+        }
+        sums.add(pixel_color, luminance_sq, samples_per_pixel - samples);
+    }
+
+    // Sizes accumulated for the image and starts from the sums in the checkpoint file, if there is
+    // one.  False when not checkpointing
+    bool resume(accumulation_buffer& accumulated) const {
+        if (checkpoint.empty()) return false;
+
+        accumulated = accumulation_buffer(image_width, image_height);
+        accumulated.key = checkpoint_key();
+        accumulation_buffer saved;
+        if (!saved.read(checkpoint)) {
+            std::FILE* f = std::fopen(checkpoint.c_str(), "rb");
+            if (!f) return true;  // a new render
+            std::fclose(f);
+            std::cerr << "ERROR: Could not read the checkpoint '" << checkpoint << "', rendering without one.\n";
+            return false;         // leave it for a look rather than overwrite it
+        }
+        if (saved.width != image_width || saved.height != image_height) {
+            std::cerr << "ERROR: The checkpoint '" << checkpoint << "' is " << saved.width << 'x' << saved.height
+                      << ", not " << image_width << 'x' << image_height << ", rendering without it.\n";
+            return false;
+        }
+        if (saved.key != accumulated.key) {
+            std::cerr << "ERROR: The checkpoint '" << checkpoint << "' is of another view or scene, rendering without it.\n";
+            return false;
+        }
+
+        accumulated = std::move(saved);
+        uint64_t samples = accumulated.total_samples();
+        if (samples > 0) {
+            // a new sequence, so the samples added aren't the ones the checkpoint's render started with
+            seed_random(static_cast<unsigned int>(random_generator()() ^ samples));
+        }
+        std::clog << "Resuming from " << checkpoint << " with " << samples << " samples\n";
+        return true;
+    }
+
+    void save_checkpoint(const accumulation_buffer& accumulated) const {
+        trace::span span("checkpoint", checkpoint);
+        if (!accumulated.write(checkpoint)) {
+            std::cerr << "ERROR: Could not write the checkpoint '" << checkpoint << "'.\n";
+        }
+    }
+
+    void write_aovs(const std::vector<color>& image, const std::vector<double>& variance) const {
+        std::vector<float> rgb, grey;
+        for (size_t p = 0; p < image.size(); p++) {
+            for (int c = 0; c < 3; c++) rgb.push_back(static_cast<float>(image[p][c]));
+            grey.push_back(static_cast<float>(variance[p]));
+        }
+
+        bool ok = write_pfm(aov_prefix + "_color.pfm", rgb.data(), image_width, image_height)
+               && write_pfm(aov_prefix + "_variance.pfm", grey.data(), image_width, image_height, 1)
+               && aovs.write(aov_prefix);
+
+        if (!ok) std::cerr << "ERROR: Could not write AOV images '" << aov_prefix << "_*.pfm'.\n";
+    }
+
+    bool load_reference(std::vector<color>& reference) const {
+        if (reference_image.empty()) return false;
+
+        std::vector<float> rgb;
+        int width, height;
+        if (!read_pfm(reference_image, rgb, width, height) || width != image_width || height != image_height) {
+            std::cerr << "ERROR: Could not load a " << image_width << 'x' << image_height
+                      << " reference image from '" << reference_image << "'.\n";
+            return false;
+        }
+
+        reference.resize(static_cast<size_t>(width) * height);
+        for (size_t p = 0; p < reference.size(); p++) {
+            reference[p] = color(rgb[3*p], rgb[3*p + 1], rgb[3*p + 2]);
+        }
+        return true;
+    }
+
+    static unsigned long long nodes_visited() {
+#ifdef RTW_STATS
+        return render_stats::local().bvh_nodes_visited;
+#else
+        return 0;
+#endif
+    }
+
+    static void report_time(const char* what, std::chrono::steady_clock::time_point start) {
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        std::clog << what << " time: " << elapsed.count() << "s\n";
+    }
 
     void initialize() {
-        image_height = static_cast<int>(image_width / aspect_ratio);
-        image_height = (image_height < 1) ? 1 : image_height;
+        image_height = height();
 
         center = lookfrom;
 
@@ -85,6 +357,7 @@ private:
         // pixel pitch vectors
         pixel_delta_u = viewport_u / image_width;
         pixel_delta_v = viewport_v / image_height;
+        pixel_spread = 2.0 * h / image_height;
 
         // location of the upper left pixel
         vec3 viewport_upper_left = center - (focus_dist * w) - viewport_u/2 - viewport_v/2;
@@ -106,7 +379,7 @@ private:
         vec3 ray_direction = pixel_sample - ray_origin;
         double ray_time = random_double();
 
-        return ray(ray_origin, ray_direction, ray_time);
+        return ray(ray_origin, ray_direction, ray_time, pixel_spread);
     }
 
     vec3 pixel_sample_square() const {
@@ -122,28 +395,101 @@ private:
         return center + (p[0] * defocus_disk_u) + (p[1] * defocus_disk_v);
     }
 
-    color ray_color(const ray &r, int depth_remaining, const hittable &world) const {
+    // One light sample from a scattering point in a medium, dimmed by the transmittance along the
+    // shadow ray (ratio tracking through heterogeneous media).  It is weighted by the balance
+    // heuristic against the scattered ray reaching the same light, whose pdf_value this mirrors
+    color sample_light(const ray& r, const hit_record& rec, const color& attenuation, const hittable& world, const hittable& lights) const {
+        ray shadow(rec.p, lights.random(rec.p), r.time());
+        double light_pdf = lights.pdf_value(rec.p, shadow.direction());
+        if (light_pdf <= 0) return color(0,0,0);
+
+        hit_record light_rec;
+        if (!lights.hit(shadow, interval(shadow.min_t(), infinity), light_rec)) return color(0,0,0);
+        color emitted = light_rec.mat->emitted(light_rec.u, light_rec.v, light_rec.p);
+        if (emitted.near_zero()) return color(0,0,0);
+
+        // stopping short of the light, which is in the world as well
+        ray_count++;
+        double transmittance = world.transmittance(shadow, interval(shadow.min_t(), light_rec.t * (1 - 1e-4)));
+        if (transmittance <= 0) return color(0,0,0);
+
+        double scattering_pdf = rec.mat->scattering_pdf(r, rec, shadow);
+        double scatter_pdf = environment ? 0.5 * (scattering_pdf + environment->pdf_value(shadow.direction())) : scattering_pdf;
+        return attenuation * emitted * (transmittance * scattering_pdf / (light_pdf + scatter_pdf));
+    }
+
+    // scatter_pdf is the density the ray was scattered with when a shadow ray also sampled the lights
+    // from its origin, and weights the light it reaches against that shadow ray
+    color ray_color(const ray &r, int depth_remaining, const hittable &world, const hittable *lights, aov_sample *first_hit = nullptr, double scatter_pdf = 0) const {
         hit_record rec;
 
         if (depth_remaining <= 0) {
             return color(0,0,0);  // this ray has been scattered so many times, it can be considered to be black (limit inplave to stop stack blowing up)
         }
 
+        ray_count++;
+        RTW_STAT(rays_by_depth[render_stats::depth_bucket(max_depth - depth_remaining)]);
+
         // If the ray hits nothing, return the background color
-        if (!world.hit(r, interval(0.001, infinity), rec)) {  // lower bound of 0.001 to ignore second intersections of reflected rays that have been floating point errored to be within the sphere. (Reduces the shadow acne problem)
-            return background;
+        if (!world.hit(r, interval(r.min_t(), infinity), rec)) {  // lower bound of min_t() to ignore second intersections of reflected rays that have been floating point errored to be within the surface. (Reduces the shadow acne problem)
+            color miss = environment ? environment->value(r.direction()) : background;
+            if (first_hit) first_hit->albedo = miss;
+            return miss;
+        }
+
+        if (first_hit) {
+            first_hit->hit = true;
+            first_hit->albedo = rec.mat->albedo_at(rec);
+            first_hit->normal = rec.normal;
+            first_hit->depth = rec.t * r.direction().length();
+            first_hit->material_id = rec.mat->id();
         }
 
         ray scattered;
         color attenuation;
         color color_from_emission = rec.mat->emitted(rec.u, rec.v, rec.p);  // DEBUG:  rec.mat is currently nullptr sometimes when using boxes 
+        if (scatter_pdf > 0 && !color_from_emission.near_zero()) {
+            double light_pdf = lights->pdf_value(r.origin(), r.direction());
+            color_from_emission = color_from_emission * (scatter_pdf / (scatter_pdf + light_pdf));
+        }
 
         if (!rec.mat->scatter(r, rec, attenuation, scattered)) {
             return color_from_emission;
         }
 
-        color color_from_scatter = attenuation * ray_color(scattered, depth_remaining-1, world);
-        return color_from_emission + color_from_scatter;
+        // In a medium the lights are sampled with a shadow ray instead of being one of the ways the
+        // scattered ray is picked (not at the last bounce, whose scattered ray couldn't reach them)
+        bool shadow_ray = lights && rec.mat->volumetric() && depth_remaining > 1;
+        const hittable* sampled_lights = shadow_ray ? nullptr : lights;
+        color color_from_light = shadow_ray ? sample_light(r, rec, attenuation, world, *lights) : color(0,0,0);
+        double pdf = shadow_ray ? rec.mat->scattering_pdf(r, rec, scattered) : 0;
+
+        if ((sampled_lights || environment) && rec.mat->scattering_pdf(r, rec, scattered) > 0) {
+            // Pick the direction from the material, the lights or the environment with equal probability and
+            // weight by the pdf of the mixture, so every way of reaching a light is accounted for exactly once
+            double weight = 1.0 / (1 + (sampled_lights ? 1 : 0) + (environment ? 1 : 0));
+            double pick = random_double();
+
+            if (sampled_lights && pick < weight) {
+                scattered = ray(rec.p, sampled_lights->random(rec.p), r.time());
+            } else if (environment && pick >= 1 - weight) {
+                scattered = ray(rec.p, environment->random(), r.time());
+            }
+
+            double scattering_pdf = rec.mat->scattering_pdf(r, rec, scattered);
+            pdf = weight * scattering_pdf;
+            if (sampled_lights) pdf += weight * sampled_lights->pdf_value(rec.p, scattered.direction());
+            if (environment) pdf += weight * environment->pdf_value(scattered.direction());
+
+            if (scattering_pdf <= 0 || pdf <= 0) {
+                return color_from_emission + color_from_light;
+            }
+
+            attenuation = attenuation * (scattering_pdf / pdf);
+        }
+
+        color color_from_scatter = attenuation * ray_color(scattered, depth_remaining-1, world, lights, nullptr, shadow_ray ? pdf : 0);
+        return color_from_emission + color_from_light + color_from_scatter;
     }
 
 };
@@ -2,13 +2,18 @@
 #define COLOR_H
 
 #include "vec3.h"
+#include "fast_math.h"
 
 #include <iostream>
 
 using color = vec3;
 
 inline double linear_to_gamma(double linear_componenet) {
-    return sqrt(linear_componenet);
+    return rtw_sqrt(linear_componenet);
+}
+
+inline double luminance(const color& c) {
+    return 0.2126*c.x() + 0.7152*c.y() + 0.0722*c.z();
 }
 
 void write_color(std::ostream &out, const color pixel_color, int samples_per_pixel) {
@@ -2,29 +2,41 @@
 #define CONSTANT_MEDIUM_H
 
 #include "rtweekend.h"
+#include "fast_math.h"
 #include "hittable.h"
 #include "material.h"
+#include "stats.h"
 #include "texture.h"
 
 class constant_medium : public hittable {
 public:
 
     constant_medium(shared_ptr<hittable> b, double d, shared_ptr<texture> a) 
-        : boundary(b), neg_inv_denisty(-1/d), phase_function(make_shared<isotropic>(a)) {}
+        : boundary(b), bbox(b->bounding_box()), neg_inv_denisty(-1/d), phase_function(make_shared<isotropic>(a)) {}
 
     constant_medium(shared_ptr<hittable> b, double d, color c) 
-        : boundary(b), neg_inv_denisty(-1/d), phase_function(make_shared<isotropic>(c)) {}
+        : boundary(b), bbox(b->bounding_box()), neg_inv_denisty(-1/d), phase_function(make_shared<isotropic>(c)) {}
     
     bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        RTW_STAT(primitive_tests[stat_constant_medium]);
+
         // print occasional samples when debugging.  To enable, set enableDebug true
         const bool enableDebug = false;
         const bool debugging = enableDebug && random_double() < 0.00001;
 
+        // Cheap rejection before probing the boundary itself: the part of the ray
+        // within ray_t has to pass through the boundary's box to reach the medium
+        interval box_t = ray_t;
+        if (!bbox.hit(r, box_t)) return false;
+
         hit_record rec1, rec2;
 
+        RTW_STAT(medium_probes);
         if (!boundary->hit(r, universe, rec1)) return false;
 
-        if (!boundary->hit(r, interval(rec1.t+0.0001, infinity), rec2)) return false;
+        RTW_STAT(medium_probes);
+        ray exit_search(r.at(rec1.t), r.direction());  // past the entry point, without hitting it again
+        if (!boundary->hit(r, interval(rec1.t + exit_search.min_t(), infinity), rec2)) return false;
 
         if (debugging) std::clog << "\n ray_tmin=" << rec1.t << ", ray_tmax=" << rec2.t << '\n';
 
@@ -37,11 +49,11 @@ public:
 
         double ray_length = r.direction().length();
         double distance_inside_boundary = (rec2.t - rec1.t) * ray_length;
-        double hit_distance = neg_inv_denisty * log(random_double());
+        double hit_distance = neg_inv_denisty * rtw_log(1 - random_double());
         
         if (hit_distance > distance_inside_boundary) return false;
 
-        rec1.t = rec1.t + hit_distance / ray_length;
+        rec.t = rec1.t + hit_distance / ray_length;
         rec.p = r.at(rec.t);
 
         if (debugging) {
@@ -58,10 +70,28 @@ public:
         return true;
     }
 
-    aabb bounding_box() const override { return boundary-> bounding_box(); }
+    // Exact for a constant density: exp(-density * distance inside the boundary)
+    double transmittance(const ray& r, interval ray_t) const override {
+        interval box_t = ray_t;
+        if (!bbox.hit(r, box_t)) return 1.0;
+
+        hit_record rec1, rec2;
+        if (!boundary->hit(r, universe, rec1)) return 1.0;
+        ray exit_search(r.at(rec1.t), r.direction());
+        if (!boundary->hit(r, interval(rec1.t + exit_search.min_t(), infinity), rec2)) return 1.0;
+
+        double t0 = fmax(rec1.t, fmax(ray_t.min, 0.0));
+        double t1 = fmin(rec2.t, ray_t.max);
+        if (t0 >= t1) return 1.0;
+
+        return std::exp((t1 - t0) * r.direction().length() / neg_inv_denisty);
+    }
+
+    aabb bounding_box() const override { return bbox; }
 
 private:
     shared_ptr<hittable> boundary;
+    aabb bbox;
     double neg_inv_denisty;
     shared_ptr<material> phase_function;
 };
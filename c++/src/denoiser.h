@@ -0,0 +1,131 @@
+#ifndef DENOISER_H
+#define DENOISER_H
+
+#include "rtweekend.h"
+#include "aov.h"
+#include "parallel.h"
+
+#include <vector>
+
+// Edge-aware a-trous wavelet denoiser (Dammertz et al. 2010, with the variance
+// guided luminance weight of SVGF).
+//
+// The image is divided by the albedo AOV so texture detail isn't blurred, then
+// filtered with a 5x5 B3-spline kernel whose taps are spread 1, 2, 4, ... pixels
+// apart over successive iterations.  Each tap is weighted down where the normal,
+// depth or (relative to the pixel's noise level) luminance differs, so edges survive.
+class atrous_denoiser {
+public:
+    int    iterations   = 5;    // filter passes, the footprint grows to 4 * 2^iterations pixels
+    double sigma_color  = 4;    // luminance tolerance, in standard deviations of the pixel's noise
+    double sigma_normal = 128;  // exponent on the cosine between normals
+    double sigma_depth  = 0.1;  // relative depth tolerance, per pixel of tap spacing
+
+    // image holds the per pixel mean colour, variance the variance of that mean
+    std::vector<color> denoise(const std::vector<color>& image, const std::vector<double>& variance,
+                               const aov_buffers& aovs, int width, int height) const {
+        size_t n = image.size();
+        std::vector<color> albedo(n), irradiance(n), filtered(n);
+        std::vector<vec3> normal(n);
+        std::vector<double> depth(n), var(variance), filtered_var(n);
+
+        for (int j = 0; j < height; j++) {
+            for (int i = 0; i < width; i++) {
+                size_t p = static_cast<size_t>(j)*width + i;
+                albedo[p] = demodulation_albedo(aovs.albedo(i, j));
+                irradiance[p] = color(image[p].x() / albedo[p].x(), image[p].y() / albedo[p].y(), image[p].z() / albedo[p].z());
+                vec3 nrm = aovs.normal(i, j);
+                normal[p] = nrm.length_squared() > 0 ? unit_vector(nrm) : nrm;
+                depth[p] = aovs.depth(i, j);
+                double a = luminance(albedo[p]);
+                var[p] = variance[p] / (a*a);
+            }
+        }
+
+        for (int iter = 0; iter < iterations; iter++) {
+            int step = 1 << iter;
+
+            parallel_for(height, [&](int j) {
+                for (int i = 0; i < width; i++) {
+                    filter_pixel(i, j, step, width, height, irradiance, var, normal, depth,
+                                 filtered[static_cast<size_t>(j)*width + i], filtered_var[static_cast<size_t>(j)*width + i]);
+                }
+            });
+
+            irradiance.swap(filtered);
+            var.swap(filtered_var);
+        }
+
+        std::vector<color> result(n);
+        for (size_t p = 0; p < n; p++) {
+            result[p] = irradiance[p] * albedo[p];
+        }
+        return result;
+    }
+
+private:
+    void filter_pixel(int i, int j, int step, int width, int height,
+                      const std::vector<color>& irradiance, const std::vector<double>& var,
+                      const std::vector<vec3>& normal, const std::vector<double>& depth,
+                      color& out, double& out_var) const {
+        static const double kernel[5] = { 1.0/16, 1.0/4, 3.0/8, 1.0/4, 1.0/16 };
+
+        size_t p = static_cast<size_t>(j)*width + i;
+        double l_p = luminance(irradiance[p]);
+        double sigma_l = sigma_color * sqrt(fmax(var[p], 0.0)) + 1e-6;
+        bool hit_p = normal[p].length_squared() > 0;
+
+        color sum(0,0,0);
+        double sum_w = 0;
+        double sum_var = 0;
+
+        for (int dy = -2; dy <= 2; dy++) {
+            int y = j + dy*step;
+            if (y < 0 || y >= height) continue;
+
+            for (int dx = -2; dx <= 2; dx++) {
+                int x = i + dx*step;
+                if (x < 0 || x >= width) continue;
+
+                size_t q = static_cast<size_t>(y)*width + x;
+                bool hit_q = normal[q].length_squared() > 0;
+                if (hit_p != hit_q) continue;  // never blend geometry with the background
+
+                double w = kernel[dx+2] * kernel[dy+2];
+
+                if (hit_p) {
+                    double cos_n = fmax(0.0, dot(normal[p], normal[q]));
+                    w *= pow(cos_n, sigma_normal);
+                    w *= exp(-fabs(depth[p] - depth[q]) / (sigma_depth * step * fmax(depth[p], 1e-6)));
+                }
+
+                w *= exp(-fabs(l_p - luminance(irradiance[q])) / sigma_l);
+
+                sum += w * irradiance[q];
+                sum_w += w;
+                sum_var += w * w * var[q];
+            }
+        }
+
+        // the centre tap always has weight (3/8)^2, so sum_w > 0
+        out = sum / sum_w;
+        out_var = sum_var / (sum_w * sum_w);
+    }
+
+    static color demodulation_albedo(const color& a) {
+        // albedo channels near zero carry no information about the lighting, leave those undivided
+        const double eps = 1e-3;
+        return color(a.x() > eps ? a.x() : 1, a.y() > eps ? a.y() : 1, a.z() > eps ? a.z() : 1);
+    }
+};
+
+// Root mean square difference between two images of the same size
+inline double rmse(const std::vector<color>& a, const std::vector<color>& b) {
+    double sum = 0;
+    for (size_t n = 0; n < a.size(); n++) {
+        sum += (a[n] - b[n]).length_squared();
+    }
+    return sqrt(sum / (3.0 * a.size()));
+}
+
+#endif
@@ -0,0 +1,208 @@
+#ifndef DENSITY_GRID_H
+#define DENSITY_GRID_H
+
+#include "rtweekend.h"
+#include "aabb.h"
+#include "perlin.h"
+
+#include <vector>
+
+// Spatially varying density of a participating medium
+class density_field {
+public:
+    virtual ~density_field() = default;
+
+    virtual double density(const point3& p) const = 0;
+
+    // Upper bound on density(p) for every p within box
+    virtual double max_density(const aabb& box) const = 0;
+};
+
+
+// Density samples on a regular lattice spanning `bounds`, trilinearly interpolated
+class grid_density : public density_field {
+public:
+    grid_density(const aabb& bounds, int nx, int ny, int nz, const std::vector<double>& values)
+        : bounds(bounds), nx(nx), ny(ny), nz(nz), values(values) {}
+
+    // Build the lattice by sampling f(p) at each lattice point
+    template <typename F>
+    static shared_ptr<grid_density> sample(const aabb& bounds, int nx, int ny, int nz, F f) {
+        std::vector<double> values(static_cast<size_t>(nx) * ny * nz);
+        for (int k = 0; k < nz; k++) {
+            for (int j = 0; j < ny; j++) {
+                for (int i = 0; i < nx; i++) {
+                    point3 p(lerp(bounds.x, i, nx), lerp(bounds.y, j, ny), lerp(bounds.z, k, nz));
+                    values[(static_cast<size_t>(k)*ny + j)*nx + i] = fmax(0.0, f(p));
+                }
+            }
+        }
+        return make_shared<grid_density>(bounds, nx, ny, nz, values);
+    }
+
+    double density(const point3& p) const override {
+        double x = local(bounds.x, p.x(), nx);
+        double y = local(bounds.y, p.y(), ny);
+        double z = local(bounds.z, p.z(), nz);
+
+        int i = static_cast<int>(x);
+        int j = static_cast<int>(y);
+        int k = static_cast<int>(z);
+        double u = x - i;
+        double v = y - j;
+        double w = z - k;
+
+        double accum = 0.0;
+        for (int di = 0; di < 2; di++) {
+            for (int dj = 0; dj < 2; dj++) {
+                for (int dk = 0; dk < 2; dk++) {
+                    accum += (di*u + (1-di)*(1-u)) * (dj*v + (1-dj)*(1-v)) * (dk*w + (1-dk)*(1-w))
+                           * at(i+di, j+dj, k+dk);
+                }
+            }
+        }
+        return accum;
+    }
+
+    double max_density(const aabb& box) const override {
+        // trilinear interpolation never exceeds the lattice points around it
+        int i0 = static_cast<int>(local(bounds.x, box.x.min, nx)), i1 = static_cast<int>(local(bounds.x, box.x.max, nx)) + 1;
+        int j0 = static_cast<int>(local(bounds.y, box.y.min, ny)), j1 = static_cast<int>(local(bounds.y, box.y.max, ny)) + 1;
+        int k0 = static_cast<int>(local(bounds.z, box.z.min, nz)), k1 = static_cast<int>(local(bounds.z, box.z.max, nz)) + 1;
+
+        double max_d = 0.0;
+        for (int k = k0; k <= k1; k++) {
+            for (int j = j0; j <= j1; j++) {
+                for (int i = i0; i <= i1; i++) {
+                    max_d = fmax(max_d, at(i, j, k));
+                }
+            }
+        }
+        return max_d;
+    }
+
+private:
+    aabb bounds;
+    int nx, ny, nz;
+    std::vector<double> values;
+
+    double at(int i, int j, int k) const {
+        i = i < 0 ? 0 : (i >= nx ? nx-1 : i);
+        j = j < 0 ? 0 : (j >= ny ? ny-1 : j);
+        k = k < 0 ? 0 : (k >= nz ? nz-1 : k);
+        return values[(static_cast<size_t>(k)*ny + j)*nx + i];
+    }
+
+    static double local(const interval& extent, double x, int n) {
+        // continuous lattice coordinate of x, clamped to the lattice
+        if (n < 2 || extent.size() <= 0) return 0;
+        return interval(0, n-1).clamp((x - extent.min) / extent.size() * (n-1));
+    }
+
+    static double lerp(const interval& extent, int i, int n) {
+        return (n < 2) ? extent.min : extent.min + extent.size() * i / (n-1);
+    }
+};
+
+
+// Density driven by Perlin turbulence: density * min(turb(scale * p), 1)
+class perlin_density : public density_field {
+public:
+    perlin_density(double density, double scale, unsigned int seed = 0) : noise(seed), peak(density), scale(scale) {}
+
+    double density(const point3& p) const override {
+        return peak * fmin(noise.turb(scale * p), 1.0);
+    }
+
+    double max_density(const aabb& box) const override { return peak; }
+
+private:
+    perlin noise;
+    double peak;
+    double scale;
+};
+
+
+// Coarse grid of per cell upper bounds of a density_field, used as the majorant for delta and ratio tracking
+class majorant_grid {
+public:
+    majorant_grid() {}
+
+    majorant_grid(const density_field& field, const aabb& bounds, int resolution)
+        : bounds(bounds), res(resolution < 1 ? 1 : resolution), majorants(res*res*res) {
+        for (int k = 0; k < res; k++) {
+            for (int j = 0; j < res; j++) {
+                for (int i = 0; i < res; i++) {
+                    majorants[(k*res + j)*res + i] = field.max_density(cell_bounds(i, j, k));
+                }
+            }
+        }
+    }
+
+    // Call f(t0, t1, majorant) for each cell the ray passes through within ray_t, front to back,
+    // stopping early when f returns false
+    template <typename F>
+    void traverse(const ray& r, interval ray_t, F f) const {
+        interval t = ray_t;
+        if (!bounds.hit(r, t)) return;
+
+        // 3D-DDA through the cells
+        point3 start = r.at(t.min);
+        int cell[3], step[3], last[3];
+        double next_t[3], delta_t[3];
+
+        for (int a = 0; a < 3; a++) {
+            const interval& extent = bounds.axis(a);
+            double size = extent.size() / res;
+            double d = r.direction()[a];
+
+            cell[a] = static_cast<int>(size > 0 ? (start[a] - extent.min) / size : 0);
+            cell[a] = cell[a] < 0 ? 0 : (cell[a] >= res ? res-1 : cell[a]);
+
+            if (d > 0) {
+                step[a] = 1;
+                last[a] = res;
+                next_t[a] = t.min + (extent.min + (cell[a]+1)*size - start[a]) / d;
+                delta_t[a] = size / d;
+            } else if (d < 0) {
+                step[a] = -1;
+                last[a] = -1;
+                next_t[a] = t.min + (extent.min + cell[a]*size - start[a]) / d;
+                delta_t[a] = -size / d;
+            } else {
+                step[a] = 0;
+                last[a] = -2;
+                next_t[a] = infinity;
+                delta_t[a] = infinity;
+            }
+        }
+
+        double t0 = t.min;
+        while (t0 < t.max) {
+            int axis = (next_t[0] < next_t[1]) ? ((next_t[0] < next_t[2]) ? 0 : 2)
+                                               : ((next_t[1] < next_t[2]) ? 1 : 2);
+            double t1 = fmin(next_t[axis], t.max);
+
+            if (!f(t0, t1, majorants[(cell[2]*res + cell[1])*res + cell[0]])) return;
+
+            cell[axis] += step[axis];
+            if (cell[axis] == last[axis]) return;
+            t0 = t1;
+            next_t[axis] += delta_t[axis];
+        }
+    }
+
+private:
+    aabb bounds;
+    int res = 1;
+    std::vector<double> majorants;
+
+    aabb cell_bounds(int i, int j, int k) const {
+        double sx = bounds.x.size() / res, sy = bounds.y.size() / res, sz = bounds.z.size() / res;
+        return aabb(interval(bounds.x.min + i*sx, bounds.x.min + (i+1)*sx),
+                    interval(bounds.y.min + j*sy, bounds.y.min + (j+1)*sy),
+                    interval(bounds.z.min + k*sz, bounds.z.min + (k+1)*sz));
+    }
+};
+
+#endif
@@ -0,0 +1,589 @@
+#ifndef DISTRIBUTED_H
+#define DISTRIBUTED_H
+
+// One frame rendered by many processes: a coordinator cuts the image into tiles and hands them to
+// worker processes, which send back each tile's per pixel sums (see accumulation.h).
+//
+//   ../out/main --distribute SCENE [--workers N] [--listen PORT] [--tile PIXELS] [--width W] [--spp N]
+//               [--seed S] [--accumulation FILE] > image.ppm
+//   ../out/main --worker HOST:PORT      on another host, joining a coordinator started with --listen
+//
+// SCENE is a scene file or built-in scene, which every worker loads itself (so a scene file must be
+// at the same path on every host, and every host must run the same build).  --workers starts that
+// many local workers over socket pairs, --listen also takes workers connecting over TCP at any time.
+//
+// Each worker renders a tile with camera::render_tile, so a pixel gets the same samples as in
+// camera::render, from a random sequence seeded by the tile and --seed.  A tile therefore comes
+// out the same whichever worker renders it and however many there are.  Once every tile has been
+// handed out, idle workers are given copies of tiles that have run for more than twice the average,
+// and the first copy back is used.  A worker that fails or disconnects has its tiles handed out again.
+// Every worker's throughput is reported at the end.  With only --listen, the coordinator waits for as
+// long as it takes a worker to join.
+
+#include "rtweekend.h"
+#include "accumulation.h"
+#include "color.h"
+#include "render_server.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Lines and raw bytes over a socket or pipe
+class stream_fd {
+public:
+    explicit stream_fd(int fd) : fd(fd) {}
+
+    bool read_line(std::string& line) {
+        while (true) {
+            size_t newline = pending.find('\n');
+            if (newline != std::string::npos) {
+                line = pending.substr(0, newline);
+                pending.erase(0, newline + 1);
+                return true;
+            }
+            if (!fill()) return false;
+        }
+    }
+
+    bool read_bytes(void* data, size_t bytes) {
+        char* p = static_cast<char*>(data);
+        while (bytes > 0) {
+            if (pending.empty() && !fill()) return false;
+            size_t n = std::min(bytes, pending.size());
+            std::memcpy(p, pending.data(), n);
+            pending.erase(0, n);
+            p += n;
+            bytes -= n;
+        }
+        return true;
+    }
+
+    bool write_bytes(const void* data, size_t bytes) {
+        const char* p = static_cast<const char*>(data);
+        while (bytes > 0) {
+            ssize_t n = send(fd, p, bytes, MSG_NOSIGNAL);
+            if (n < 0 && errno == ENOTSOCK) n = write(fd, p, bytes);  // a pipe, e.g. through ssh
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            p += n;
+            bytes -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    bool write_line(const std::string& line) {
+        std::string text = line + '\n';
+        return write_bytes(text.data(), text.size());
+    }
+
+private:
+    int fd;
+    std::string pending;
+
+    bool fill() {
+        char buffer[65536];
+        while (true) {
+            ssize_t n = read(fd, buffer, sizeof(buffer));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            pending.append(buffer, static_cast<size_t>(n));
+            return true;
+        }
+    }
+};
+
+// The seed of a tile's random sequence
+inline unsigned int tile_seed(unsigned int seed, int x0, int y0) {
+    uint64_t h = 14695981039346656037ull;
+    uint64_t values[3] = { seed, static_cast<uint64_t>(x0), static_cast<uint64_t>(y0) };
+    for (uint64_t v : values) h = (h ^ v) * 1099511628211ull;
+    return static_cast<unsigned int>(h ^ (h >> 32));
+}
+
+// Renders the tiles a coordinator sends on in, answering on out, until it says quit or goes away.
+//
+//   coordinator: scene <name> <width or 0> <spp or 0> <seed>   worker: ready <width> <height> <key>
+//   coordinator: tile <id> <x0> <y0> <x1> <y1>                 worker: result <id> <rays> <seconds>
+//                                                                      and the tile's pixels, rows top to bottom
+//   coordinator: quit
+inline int run_worker(int in, int out) {
+    stream_fd input(in), output(out);
+    std::string line, command, name;
+    int width = 0, spp = 0;
+    unsigned int seed = 0;
+
+    std::istringstream words;
+    if (!input.read_line(line)) return 1;
+    words.str(line);
+    if (!(words >> command >> name >> width >> spp >> seed) || command != "scene") {
+        output.write_line("error expected a scene");
+        return 1;
+    }
+
+    scene_store scenes;
+    std::string error;
+    shared_ptr<const scene> s = scenes.get(name, error);
+    if (!s) {
+        output.write_line("error " + error);
+        return 1;
+    }
+
+    camera cam = s->cam;
+    if (width > 0) cam.image_width = width;
+    if (spp > 0) cam.samples_per_pixel = spp;
+    accumulation_buffer image(cam.image_width, cam.height());
+    if (!output.write_line("ready " + std::to_string(image.width) + ' ' + std::to_string(image.height) + ' '
+                           + std::to_string(cam.checkpoint_key()))) return 1;
+
+    std::vector<accumulated_pixel> tile;
+    while (input.read_line(line)) {
+        std::istringstream tile_words(line);
+        int id, x0, y0, x1, y1;
+        if (!(tile_words >> command)) continue;
+        if (command == "quit") return 0;
+        if (command != "tile" || !(tile_words >> id >> x0 >> y0 >> x1 >> y1)
+            || x0 < 0 || y0 < 0 || x1 > image.width || y1 > image.height || x0 >= x1 || y0 >= y1) {
+            output.write_line("error bad tile '" + line + "'");
+            return 1;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        unsigned long long rays_before = cam.rays_traced();
+        seed_random(tile_seed(seed, x0, y0));
+        for (int j = y0; j < y1; j++) {
+            for (int i = x0; i < x1; i++) image.at(i, j) = accumulated_pixel();
+        }
+        cam.render_tile(s->world, s->lights.get(), x0, y0, x1, y1, image);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        tile.clear();
+        for (int j = y0; j < y1; j++) {
+            for (int i = x0; i < x1; i++) tile.push_back(image.at(i, j));
+        }
+        std::ostringstream result;
+        result << "result " << id << ' ' << cam.rays_traced() - rays_before << ' ' << elapsed.count();
+        if (!output.write_line(result.str()) || !output.write_bytes(tile.data(), tile.size() * sizeof(accumulated_pixel))) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Joins the coordinator listening at host:port as a worker
+inline int run_worker(const std::string& address) {
+    size_t colon = address.rfind(':');
+    if (colon == std::string::npos) {
+        std::cerr << "ERROR: Expected HOST:PORT, not '" << address << "'.\n";
+        return 2;
+    }
+    std::string host = address.substr(0, colon), port = address.substr(colon + 1);
+
+    addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* found = nullptr;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &found) != 0) {
+        std::cerr << "ERROR: Could not find the coordinator '" << address << "'.\n";
+        return 1;
+    }
+
+    int fd = -1;
+    for (addrinfo* a = found; a && fd < 0; a = a->ai_next) {
+        fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (fd >= 0 && connect(fd, a->ai_addr, a->ai_addrlen) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(found);
+    if (fd < 0) {
+        std::cerr << "ERROR: Could not connect to the coordinator '" << address << "'.\n";
+        return 1;
+    }
+
+    int status = run_worker(fd, fd);
+    close(fd);
+    return status;
+}
+
+struct distributed_settings {
+    std::string scene;
+    std::string program;      // this executable, to start local workers with
+    int workers = 0;          // local worker processes
+    int port = 0;             // TCP port remote workers join on, none when 0
+    int tile_size = 32;
+    int width = 0, spp = 0;   // 0 keeps the scene's own
+    unsigned int seed = 1;
+    std::string accumulation; // also write the frame's sums here, for accum_merge or a --checkpoint
+};
+
+class coordinator {
+public:
+    explicit coordinator(const distributed_settings& settings) : settings(settings) {}
+
+    // Renders the frame and writes it as a PPM to out, false when that couldn't be done
+    bool run(std::ostream& out) {
+        auto start = std::chrono::steady_clock::now();
+
+        if (settings.workers <= 0 && settings.port <= 0) {
+            std::cerr << "ERROR: No workers, give --workers or --listen.\n";
+            return false;
+        }
+        for (int w = 0; w < settings.workers; w++) start_local_worker();
+        if (settings.port > 0 && !listen_for_workers()) {
+            finish();
+            return false;
+        }
+
+        bool rendered;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [this]() {
+                return (started && remaining == 0) || (alive == 0 && listener < 0);  // done, or no one left to do it
+            });
+            rendered = started && remaining == 0;
+        }
+        finish();
+
+        if (!rendered) {
+            std::cerr << "ERROR: Every worker failed before the frame was done.\n";
+            return false;
+        }
+
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        report(elapsed.count());
+
+        trace::span output_span("write PPM");
+        out << "P3\n" << frame.width << ' ' << frame.height << "\n255\n";
+        for (const auto& p : frame.pixels) write_color(out, p.mean(), 1);
+
+        if (!settings.accumulation.empty() && !frame.write(settings.accumulation)) {
+            std::cerr << "ERROR: Could not write '" << settings.accumulation << "'.\n";
+        }
+        return true;
+    }
+
+private:
+    struct tile {
+        int x0, y0, x1, y1;
+        bool done = false;
+        int running = 0;    // copies being rendered
+        std::chrono::steady_clock::time_point first_issued;
+    };
+
+    struct worker_link {
+        int fd;
+        pid_t pid = -1;     // a local worker's process
+        std::string name;
+        std::thread thread;
+        int tiles = 0, reissued = 0, wasted = 0;
+        unsigned long long rays = 0, pixels = 0;
+        double busy = 0;    // seconds rendering, as the worker measured
+    };
+
+    distributed_settings settings;
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::vector<std::unique_ptr<worker_link>> links;
+    std::vector<tile> tiles;
+    std::deque<int> queue;  // tiles never handed out, or whose workers failed
+    accumulation_buffer frame;
+    bool started = false;
+    int remaining = 0, alive = 0, finished_tiles = 0;
+    double finished_seconds = 0;
+    int listener = -1;
+    std::thread acceptor;
+
+    void start_local_worker() {
+        int pair[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) != 0) {
+            std::cerr << "ERROR: Could not start a worker: " << std::strerror(errno) << ".\n";
+            return;
+        }
+        pid_t pid = fork();
+        if (pid == 0) {
+            dup2(pair[1], 0);
+            dup2(pair[1], 1);
+            close(pair[0]);
+            close(pair[1]);
+            char* args[] = { const_cast<char*>(settings.program.c_str()), const_cast<char*>("--worker"), nullptr };
+            execvp(args[0], args);
+            _exit(127);
+        }
+        close(pair[1]);
+        if (pid < 0) {
+            std::cerr << "ERROR: Could not start a worker: " << std::strerror(errno) << ".\n";
+            close(pair[0]);
+            return;
+        }
+        add_worker(pair[0], "local " + std::to_string(pid), pid);
+    }
+
+    bool listen_for_workers() {
+        listener = socket(AF_INET, SOCK_STREAM, 0);
+        int on = 1;
+        sockaddr_in address;
+        std::memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+        address.sin_port = htons(static_cast<uint16_t>(settings.port));
+        if (listener < 0 || setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) != 0
+            || bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listener, 16) != 0) {
+            std::cerr << "ERROR: Could not listen on port " << settings.port << ": " << std::strerror(errno) << ".\n";
+            if (listener >= 0) close(listener);
+            listener = -1;
+            return false;
+        }
+        std::clog << "Waiting for workers on port " << settings.port << '\n';
+
+        acceptor = std::thread([this]() {
+            while (true) {
+                sockaddr_in peer;
+                socklen_t size = sizeof(peer);
+                int fd = accept(listener, reinterpret_cast<sockaddr*>(&peer), &size);
+                if (fd < 0) {
+                    if (errno == EINTR || errno == ECONNABORTED) continue;
+                    return;  // shut down once the frame is done
+                }
+                char host[NI_MAXHOST] = "?";
+                getnameinfo(reinterpret_cast<sockaddr*>(&peer), size, host, sizeof(host), nullptr, 0, NI_NUMERICHOST);
+                add_worker(fd, std::string(host) + ':' + std::to_string(ntohs(peer.sin_port)), -1);
+            }
+        });
+        return true;
+    }
+
+    void add_worker(int fd, const std::string& name, pid_t pid) {
+        std::lock_guard<std::mutex> lock(mutex);
+        links.push_back(std::unique_ptr<worker_link>(new worker_link()));
+        worker_link* link = links.back().get();
+        link->fd = fd;
+        link->pid = pid;
+        link->name = name;
+        alive++;
+        link->thread = std::thread([this, link]() { serve(*link); });
+    }
+
+    // Feeds one worker tiles until the frame is done or the worker fails
+    void serve(worker_link& link) {
+        stream_fd stream(link.fd);
+        std::ostringstream scene_line;
+        scene_line << "scene " << settings.scene << ' ' << settings.width << ' ' << settings.spp << ' ' << settings.seed;
+
+        std::string line, word, error;
+        int width = 0, height = 0;
+        uint64_t key = 0;
+        bool ready = stream.write_line(scene_line.str()) && stream.read_line(line);
+        std::istringstream words(line);
+        ready = ready && (words >> word >> width >> height >> key) && word == "ready" && start(width, height, key, error);
+        if (!ready) {
+            if (error.empty()) error = line.compare(0, 6, "error ") == 0 ? line.substr(6) : "no answer";
+            lost(link, -1, error);
+            return;
+        }
+
+        std::vector<accumulated_pixel> pixels;
+        int id;
+        bool reissue;
+        while (next(id, reissue)) {
+            const tile& t = tiles[id];  // the tile list doesn't change once the frame has started
+            std::ostringstream tile_line;
+            tile_line << "tile " << id << ' ' << t.x0 << ' ' << t.y0 << ' ' << t.x1 << ' ' << t.y1;
+
+            int result_id;
+            unsigned long long rays;
+            double seconds;
+            pixels.resize(static_cast<size_t>(t.x1 - t.x0) * (t.y1 - t.y0));
+            bool ok = stream.write_line(tile_line.str()) && stream.read_line(line);
+            std::istringstream result(line);
+            ok = ok && (result >> word >> result_id >> rays >> seconds) && word == "result" && result_id == id
+                    && stream.read_bytes(pixels.data(), pixels.size() * sizeof(accumulated_pixel));
+            if (!ok) {
+                lost(link, id, line.compare(0, 6, "error ") == 0 ? line.substr(6) : "disconnected");
+                return;
+            }
+            completed(link, id, reissue, pixels, rays, seconds);
+        }
+
+        stream.write_line("quit");
+        std::lock_guard<std::mutex> lock(mutex);
+        alive--;
+        changed.notify_all();
+    }
+
+    // Cuts the frame into tiles when the first worker says how big it is and what it renders, false
+    // when a later one disagrees (e.g. it has another version of the scene file)
+    bool start(int width, int height, uint64_t key, std::string& error) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (started) {
+            if (width == frame.width && height == frame.height && key == frame.key) return true;
+            error = width == frame.width && height == frame.height ? "renders another view or scene"
+                  : "renders " + std::to_string(width) + 'x' + std::to_string(height) + ", not "
+                    + std::to_string(frame.width) + 'x' + std::to_string(frame.height);
+            return false;
+        }
+        if (width <= 0 || height <= 0) {
+            error = "bad image size";
+            return false;
+        }
+
+        frame = accumulation_buffer(width, height);
+        frame.key = key;
+        int size = std::max(1, settings.tile_size);
+        for (int y = 0; y < height; y += size) {
+            for (int x = 0; x < width; x += size) {
+                tile t;
+                t.x0 = x;
+                t.y0 = y;
+                t.x1 = std::min(x + size, width);
+                t.y1 = std::min(y + size, height);
+                queue.push_back(static_cast<int>(tiles.size()));
+                tiles.push_back(t);
+            }
+        }
+        remaining = static_cast<int>(tiles.size());
+        started = true;
+        std::clog << "Rendering " << width << 'x' << height << " in " << tiles.size() << " tiles\n";
+        return true;
+    }
+
+    // The next tile for a worker: one not yet handed out, or else a copy of the longest running
+    // straggler.  False once the frame is done
+    bool next(int& id, bool& reissue) {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (remaining > 0) {
+            auto now = std::chrono::steady_clock::now();
+            if (!queue.empty()) {
+                id = queue.front();
+                queue.pop_front();
+                if (tiles[id].running == 0) tiles[id].first_issued = now;
+                tiles[id].running++;
+                reissue = false;
+                return true;
+            }
+
+            // only one spare copy of a tile, and only when it's well past the average tile's time
+            double average = finished_tiles ? finished_seconds / finished_tiles : 0;
+            int straggler = -1;
+            for (size_t t = 0; t < tiles.size(); t++) {
+                const tile& candidate = tiles[t];
+                if (candidate.done || candidate.running != 1 || finished_tiles == 0) continue;
+                std::chrono::duration<double> running = now - candidate.first_issued;
+                if (running.count() < 2 * average) continue;
+                if (straggler < 0 || candidate.first_issued < tiles[straggler].first_issued) straggler = static_cast<int>(t);
+            }
+            if (straggler >= 0) {
+                id = straggler;
+                tiles[id].running++;
+                reissue = true;
+                return true;
+            }
+
+            changed.wait_for(lock, std::chrono::milliseconds(20));
+        }
+        return false;
+    }
+
+    void completed(worker_link& link, int id, bool reissue, const std::vector<accumulated_pixel>& pixels,
+                   unsigned long long rays, double seconds) {
+        std::lock_guard<std::mutex> lock(mutex);
+        tile& t = tiles[id];
+        t.running--;
+        link.busy += seconds;
+        link.rays += rays;
+        if (reissue) link.reissued++;
+        if (t.done) {  // the other copy was back first
+            link.wasted++;
+            return;
+        }
+
+        size_t p = 0;
+        for (int j = t.y0; j < t.y1; j++) {
+            for (int i = t.x0; i < t.x1; i++) frame.at(i, j) = pixels[p++];
+        }
+        t.done = true;
+        remaining--;
+        link.tiles++;
+        link.pixels += pixels.size();
+        std::chrono::duration<double> took = std::chrono::steady_clock::now() - t.first_issued;
+        finished_tiles++;
+        finished_seconds += took.count();
+        std::clog << "\rTiles remaining: " << remaining << ' ' << std::flush;
+        changed.notify_all();
+    }
+
+    // A worker failed, with tile id (or none when -1) unfinished
+    void lost(worker_link& link, int id, const std::string& why) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!started || remaining > 0) std::cerr << "ERROR: Worker " << link.name << " failed: " << why << ".\n";
+        if (id >= 0) {
+            tile& t = tiles[id];
+            t.running--;
+            if (!t.done && t.running == 0) queue.push_front(id);
+        }
+        alive--;
+        changed.notify_all();
+    }
+
+    // Stops taking workers, and waits for every worker's thread and process
+    void finish() {
+        if (listener >= 0) {
+            shutdown(listener, SHUT_RDWR);
+            if (acceptor.joinable()) acceptor.join();
+            close(listener);
+        }
+
+        std::vector<worker_link*> all;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            listener = -1;
+            for (auto& link : links) {
+                shutdown(link->fd, SHUT_RD);  // a worker still on a spare copy of a tile has its answer dropped
+                all.push_back(link.get());
+            }
+        }
+        for (worker_link* link : all) {
+            if (link->thread.joinable()) link->thread.join();
+            close(link->fd);
+            if (link->pid > 0) {
+                kill(link->pid, SIGKILL);  // it may still be on a spare copy no one needs, or stuck
+                waitpid(link->pid, nullptr, 0);
+            }
+        }
+    }
+
+    void report(double seconds) const {
+        std::clog << "\rDone in " << seconds << "s                \n";
+        for (const auto& link : links) {
+            std::clog << "  worker " << link->name << ": " << link->tiles << " tiles, " << link->pixels << " pixels, "
+                      << link->rays / 1e6 << " Mrays in " << link->busy << "s busy ("
+                      << (link->busy > 0 ? link->rays / link->busy / 1e6 : 0.0) << " Mrays/s)";
+            if (link->reissued) std::clog << ", " << link->reissued << " straggler copies (" << link->wasted << " too late)";
+            std::clog << '\n';
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,120 @@
+#ifndef ENVIRONMENT_H
+#define ENVIRONMENT_H
+
+#include "rtweekend.h"
+#include "rtw_stb_image.h"
+
+#include <algorithm>
+#include <vector>
+
+// Infinitely distant, image based light seen by rays that miss the scene.
+//
+// The image is a latitude-longitude map using the same (u,v) convention as
+// sphere::get_sphere_uv.  Directions are importance sampled from a piecewise
+// constant 2D distribution (marginal CDF over rows, conditional CDF within each
+// row) proportional to each pixel's luminance times the solid angle it covers.
+class environment_map {
+public:
+    environment_map(const char* filename, double intensity = 1.0) : image(filename), intensity(intensity) {
+        build_distribution();
+    }
+
+    color value(const vec3& direction) const {
+        int i, j;
+        direction_to_pixel(unit_vector(direction), i, j);
+        const float* pixel = image.pixel_data(i, j);
+        return intensity * color(pixel[0], pixel[1], pixel[2]);
+    }
+
+    // Solid angle density of random() generating `direction`
+    double pdf_value(const vec3& direction) const {
+        if (total <= 0) return 1 / (4*pi);
+
+        vec3 d = unit_vector(direction);
+        double sin_theta = sqrt(fmax(0.0, 1 - d.y()*d.y()));
+        if (sin_theta <= 0) return 0;
+
+        int i, j;
+        direction_to_pixel(d, i, j);
+        double p_pixel = pixel_weight(i, j) / total;
+
+        return p_pixel * width * height / (2 * pi * pi * sin_theta);
+    }
+
+    vec3 random() const {
+        if (total <= 0) return random_unit_vector();
+
+        // row from the marginal distribution, then column from that row's conditional distribution
+        int j = sample_cdf(row_cdf, 0, height, random_double() * total);
+        size_t row = static_cast<size_t>(j) * width;
+        double row_start = (j == 0) ? 0 : row_cdf[j-1];
+        int i = sample_cdf(pixel_cdf, row, width, random_double() * (row_cdf[j] - row_start));
+
+        // jitter within the pixel
+        double u = (i + random_double()) / width;
+        double v = 1 - (j + random_double()) / height;
+        return uv_to_direction(u, v);
+    }
+
+private:
+    rtw_float_image image;
+    double intensity;
+    int width = 0, height = 0;
+    std::vector<double> pixel_cdf;  // running sum of pixel weights within each row
+    std::vector<double> row_cdf;     // running sum of row totals
+    double total = 0;
+
+    void build_distribution() {
+        width = image.width();
+        height = image.height();
+        if (width <= 0 || height <= 0) return;
+
+        pixel_cdf.resize(static_cast<size_t>(width) * height);
+        row_cdf.resize(height);
+
+        for (int j = 0; j < height; j++) {
+            double sum = 0;
+            for (int i = 0; i < width; i++) {
+                sum += pixel_weight(i, j);
+                pixel_cdf[static_cast<size_t>(j)*width + i] = sum;
+            }
+            total += sum;
+            row_cdf[j] = total;
+        }
+    }
+
+    double pixel_weight(int i, int j) const {
+        // luminance of the pixel times the (relative) solid angle of its row
+        const float* pixel = image.pixel_data(i, j);
+        double theta = pi * (1 - (j + 0.5) / height);
+        return fmax(0.0, luminance(color(pixel[0], pixel[1], pixel[2]))) * sin(theta);
+    }
+
+    void direction_to_pixel(const vec3& d, int& i, int& j) const {
+        double theta = acos(fmin(1.0, fmax(-1.0, -d.y())));
+        double phi = atan2(-d.z(), d.x()) + pi;
+
+        double u = phi / (2*pi);
+        double v = theta / pi;
+
+        i = std::min(width - 1, std::max(0, static_cast<int>(u * width)));
+        j = std::min(height - 1, std::max(0, static_cast<int>((1 - v) * height)));
+    }
+
+    static vec3 uv_to_direction(double u, double v) {
+        double theta = v * pi;
+        double phi = u * 2 * pi;
+        double sin_theta = sin(theta);
+        return vec3(-sin_theta * cos(phi), -cos(theta), sin_theta * sin(phi));
+    }
+
+    static int sample_cdf(const std::vector<double>& cdf, size_t offset, int count, double x) {
+        // index of the first entry of cdf[offset, offset+count) greater than x
+        auto begin = cdf.begin() + offset;
+        auto it = std::upper_bound(begin, begin + count, x);
+        int index = static_cast<int>(it - begin);
+        return std::min(index, count - 1);
+    }
+};
+
+#endif
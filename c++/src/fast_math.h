@@ -0,0 +1,109 @@
+#ifndef FAST_MATH_H
+#define FAST_MATH_H
+
+// Polynomial approximations of the transcendental functions on the hot paths.
+//
+// Each fast_* function is branch free apart from selects, so gcc can vectorize loops over them,
+// and each has a documented maximum error over its whole domain (measured by bench/fast_math_bench).
+// Call a fast_* function directly to use the approximation at one call site, or the rtw_* wrapper,
+// which is the approximation when built with -DRTW_FAST_MATH and the <cmath> function otherwise.
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+// acos(x), clamping x to [-1,1].  Max abs error 6.8e-5 rad (Abramowitz & Stegun 4.4.45)
+inline double fast_acos(double x) {
+    double a = std::fmin(std::fabs(x), 1.0);
+    double r = std::sqrt(1.0 - a) * (1.5707288 + a * (-0.2121144 + a * (0.0742610 - 0.0187293 * a)));
+    return x < 0 ? 3.14159265358979323846 - r : r;
+}
+
+// atan2(y, x).  Max abs error 1.1e-5 rad (Abramowitz & Stegun 4.4.49)
+inline double fast_atan2(double y, double x) {
+    const double pi = 3.14159265358979323846;
+    double ax = std::fabs(x), ay = std::fabs(y);
+    double hi = std::fmax(ax, ay), lo = std::fmin(ax, ay);
+    double z = (hi > 0) ? lo / hi : 0;  // atan of z in [0,1]
+    double z2 = z * z;
+    double r = z * (0.9998660 + z2 * (-0.3302995 + z2 * (0.1801410 + z2 * (-0.0851330 + z2 * 0.0208351))));
+
+    r = (ay > ax) ? pi/2 - r : r;
+    r = (x < 0) ? pi - r : r;
+    return std::copysign(r, y);
+}
+
+// x^5 as three multiplies rather than pow's general exp(5 log x).  Max rel error 2 ulp
+inline double fast_pow5(double x) {
+    double x2 = x * x;
+    return x2 * x2 * x;
+}
+
+// Natural log of x > 0, from the exponent bits and an atanh series on the mantissa in [sqrt(1/2), sqrt(2)).
+// Max abs error 1e-9.  0 and denormals aren't handled: random_double() can return 0, so callers
+// sampling distances pass 1 - random_double(), which is in (0, 1]
+inline double fast_log(double x) {
+    uint64_t bits;
+    std::memcpy(&bits, &x, sizeof(bits));
+    int exponent = static_cast<int>((bits >> 52) & 0x7ff) - 1023;
+    bits = (bits & 0x000fffffffffffffull) | 0x3ff0000000000000ull;  // mantissa m, in [1, 2)
+    double m;
+    std::memcpy(&m, &bits, sizeof(m));
+
+    bool high = m > 1.4142135623730951;
+    m = high ? 0.5 * m : m;
+    exponent += high ? 1 : 0;
+
+    // log(m) = 2 atanh(s), s = (m-1)/(m+1) in [-0.172, 0.172)
+    double s = (m - 1) / (m + 1);
+    double s2 = s * s;
+    double log_m = 2 * s * (1 + s2 * (1.0/3 + s2 * (1.0/5 + s2 * (1.0/7 + s2 * (1.0/9)))));
+    return log_m + exponent * 0.6931471805599453;
+}
+
+// sqrt(x) for x >= 0, as x / sqrt(x) from the hardware's approximate reciprocal square root and one
+// Newton step, in float.  Max rel error 3e-7.  Measured no faster than sqrtsd on current x86, so
+// rtw_sqrt stays exact; this is for targets where sqrt is a library call
+inline double fast_sqrt(double x) {
+#ifdef __SSE__
+    float xf = static_cast<float>(x);
+    float r = _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(xf)));
+    r = r * (1.5f - 0.5f * xf * r * r);
+    return xf > 0 ? xf * r : 0.0;
+#else
+    return std::sqrt(x);
+#endif
+}
+
+// sin(x), reduced to [-pi/2, pi/2] and an odd degree 11 Taylor polynomial.
+// Max abs error 6e-8 for |x| < 1e5, degrading with the range reduction beyond that
+inline double fast_sin(double x) {
+    const double pi = 3.14159265358979323846;
+    double k = std::nearbyint(x / pi);
+    double r = x - k * pi;  // sin(x) = (-1)^k sin(r)
+    double r2 = r * r;
+    double s = r * (1 + r2 * (-1.0/6 + r2 * (1.0/120 + r2 * (-1.0/5040 + r2 * (1.0/362880 + r2 * (-1.0/39916800))))));
+    return (static_cast<int64_t>(k) & 1) ? -s : s;
+}
+
+#ifdef RTW_FAST_MATH
+inline double rtw_acos(double x) { return fast_acos(x); }
+inline double rtw_atan2(double y, double x) { return fast_atan2(y, x); }
+inline double rtw_pow5(double x) { return fast_pow5(x); }
+inline double rtw_log(double x) { return fast_log(x); }
+inline double rtw_sqrt(double x) { return std::sqrt(x); }  // see fast_sqrt
+inline double rtw_sin(double x) { return fast_sin(x); }
+#else
+inline double rtw_acos(double x) { return std::acos(x); }
+inline double rtw_atan2(double y, double x) { return std::atan2(y, x); }
+inline double rtw_pow5(double x) { return std::pow(x, 5); }
+inline double rtw_log(double x) { return std::log(x); }
+inline double rtw_sqrt(double x) { return std::sqrt(x); }
+inline double rtw_sin(double x) { return std::sin(x); }
+#endif
+
+#endif
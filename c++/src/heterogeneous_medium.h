@@ -0,0 +1,94 @@
+#ifndef HETEROGENEOUS_MEDIUM_H
+#define HETEROGENEOUS_MEDIUM_H
+
+#include "rtweekend.h"
+#include "fast_math.h"
+#include "hittable.h"
+#include "material.h"
+#include "stats.h"
+#include "texture.h"
+#include "density_grid.h"
+
+// Participating medium of varying density, filling an axis aligned box.
+//
+// Scattering distances are found with delta tracking against a coarse majorant
+// grid: tentative collisions are drawn with the cell's majorant and accepted
+// with probability density/majorant.  Shadow rays use ratio tracking against
+// the same grid for their transmittance.  Entering and leaving the medium is a
+// single slab test against its box rather than two probes of a boundary object.
+class heterogeneous_medium : public hittable {
+public:
+    heterogeneous_medium(shared_ptr<density_field> field, const aabb& bounds, shared_ptr<texture> a, int majorant_res = 16)
+        : field(field), bbox(bounds), majorants(*field, bounds, majorant_res), phase_function(make_shared<isotropic>(a)) {}
+
+    heterogeneous_medium(shared_ptr<density_field> field, const aabb& bounds, color c, int majorant_res = 16)
+        : field(field), bbox(bounds), majorants(*field, bounds, majorant_res), phase_function(make_shared<isotropic>(c)) {}
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        RTW_STAT(primitive_tests[stat_heterogeneous_medium]);
+
+        // Delta tracking
+        double ray_length = r.direction().length();
+        double hit_t = infinity;
+
+        majorants.traverse(r, ray_t, [&](double t0, double t1, double majorant) {
+            if (majorant <= 0) return true;  // empty cell, skip to the next one
+
+            double t = t0;
+            while (true) {
+                t -= rtw_log(1 - random_double()) / (majorant * ray_length);
+                if (t >= t1) return true;
+
+                if (random_double() * majorant < field->density(r.at(t))) {
+                    hit_t = t;  // real collision
+                    return false;
+                }
+                // otherwise a null collision, keep going
+            }
+        });
+
+        if (hit_t == infinity) return false;
+
+        rec.t = hit_t;
+        rec.p = r.at(rec.t);
+        rec.normal = vec3(1,0,0);  // arbitrary
+        rec.front_face = true;     // arbitrary
+        rec.mat = phase_function;
+
+        return true;
+    }
+
+    // Ratio tracking: the same tentative collisions as delta tracking, but each one weights the
+    // estimate by the chance it is a null collision rather than ending it
+    double transmittance(const ray& r, interval ray_t) const override {
+        RTW_STAT(primitive_tests[stat_heterogeneous_medium]);
+
+        double ray_length = r.direction().length();
+        double T = 1.0;
+
+        majorants.traverse(r, ray_t, [&](double t0, double t1, double majorant) {
+            if (majorant <= 0) return true;
+
+            double t = t0;
+            while (true) {
+                t -= rtw_log(1 - random_double()) / (majorant * ray_length);
+                if (t >= t1) return true;
+
+                T *= 1 - field->density(r.at(t)) / majorant;
+                if (T <= 0) return false;
+            }
+        });
+
+        return fmax(T, 0.0);
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+private:
+    shared_ptr<density_field> field;
+    aabb bbox;
+    majorant_grid majorants;
+    shared_ptr<material> phase_function;
+};
+
+#endif // HETEROGENEOUS_MEDIUM_H
@@ -11,9 +11,10 @@ public:
     point3 p;
     vec3 normal;
     shared_ptr<material> mat;
-    double t;
-    double u;
-    double v;
+    real t;
+    real u;
+    real v;
+    real uv_width = 0;  // Width of the ray's footprint at the hit in (u,v) units, for texture filtering
     bool front_face;
 
     void set_face_normal(const ray &r, const vec3 &outward_normal) {
@@ -24,12 +25,46 @@ public:
     }
 };
 
+class light_bounds {
+public:
+    // Conservative bounds on where and in which directions a light emits, used to
+    // estimate its contribution at a point without sampling it (see light_bvh)
+    aabb bounds;               // spatial extent of the emitter
+    double phi = 0;            // total emitted power (luminance), zero for non-emitters
+    vec3 w = vec3(0,0,1);      // central direction of the surface normals
+    double cos_theta_o = -1;   // spread of the surface normals about w (-1 := every direction)
+    double cos_theta_e = 0;    // spread of the emission about each normal (0 := diffuse hemisphere)
+    bool two_sided = false;    // emits from the back of each normal as well
+};
+
 class hittable {
 public:
     virtual ~hittable() = default;
 
     virtual bool hit(const ray &r, interval ray_t, hit_record &rec) const = 0;
     virtual aabb bounding_box() const = 0;
+
+    // Solid angle density of random(origin) generating `direction`
+    virtual double pdf_value(const point3& origin, const vec3& direction) const {
+        return 0.0;
+    }
+
+    // Random direction from origin towards this object
+    virtual vec3 random(const point3& origin) const {
+        return vec3(1,0,0);
+    }
+
+    // Emission bounds of this object when it is used as a light
+    virtual light_bounds emission_bounds() const {
+        return light_bounds();
+    }
+
+    // Estimate of the fraction of light getting through along r within ray_t, for shadow rays.  A
+    // surface the ray hits blocks it, media override this with how much their density lets through
+    virtual double transmittance(const ray& r, interval ray_t) const {
+        hit_record rec;
+        return hit(r, ray_t, rec) ? 0.0 : 1.0;
+    }
 };
 
 
@@ -41,7 +76,7 @@ public:
 
     bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
         // move ray backwards by the offset
-        ray offset_r(r.origin() - offset, r.direction(), r.time());
+        ray offset_r(r.origin() - offset, r.direction(), r.time(), r.spread());
 
         // determine where (if any) an intersection occurs along the offset ray
         if (!object->hit(offset_r, ray_t, rec)) return false;
@@ -54,6 +89,25 @@ public:
 
     aabb bounding_box() const override { return bbox; }
 
+    // A moved light is sampled as the object from the origin moved back by the offset
+    double pdf_value(const point3& origin, const vec3& direction) const override {
+        return object->pdf_value(origin - offset, direction);
+    }
+
+    vec3 random(const point3& origin) const override {
+        return object->random(origin - offset);
+    }
+
+    light_bounds emission_bounds() const override {
+        light_bounds lb = object->emission_bounds();
+        lb.bounds = lb.bounds + offset;
+        return lb;
+    }
+
+    double transmittance(const ray& r, interval ray_t) const override {
+        return object->transmittance(ray(r.origin() - offset, r.direction(), r.time(), r.spread()), ray_t);
+    }
+
 private:
     shared_ptr<hittable> object;
     vec3 offset;
@@ -67,75 +121,84 @@ public:
         double angle_rad = degree_to_radians(angle_deg);
         sin_theta = sin(angle_rad);
         cos_theta = cos(angle_rad);
-        bbox = object->bounding_box();
-
-        point3 min( infinity,  infinity,  infinity);
-        point3 max(-infinity, -infinity, -infinity);
-
-        for (int i = 0; i < 2; i++) {
-            for (int j = 0; j < 2; j++) {
-                for (int k = 0; k < 2; k++) {
-                    double x = i * bbox.x.max + (1-i) * bbox.x.min;
-                    double y = j * bbox.y.max + (1-j) * bbox.y.min;
-                    double z = k * bbox.z.max + (1-k) * bbox.z.min;
-
-                    double newx =  cos_theta * x + sin_theta * z;
-                    double newz = -sin_theta * x + cos_theta * z;
-
-                    vec3 tester(newx, y, newz);
-
-                    for (int c = 0; c < 3; c++) {
-                        min[c] = fmin(min[c], tester[c]);
-                        max[c] = fmax(max[c], tester[c]);
-
-                    }
-                }
-            }
-        }
-
-        bbox = aabb(min, max);
+        bbox = rotated(object->bounding_box());
     }
 
     bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
         // change the ray from world space to object space
-        point3 origin = r.origin();
-        vec3 direction = r.direction();
-
-
-        origin[0] = cos_theta * r.origin()[0] - sin_theta * r.origin()[2];
-        origin[2] = sin_theta * r.origin()[0] + cos_theta * r.origin()[2];
-
-        direction[0] = cos_theta * r.direction()[0] - sin_theta * r.direction()[2];
-        direction[2] = sin_theta * r.direction()[0] + cos_theta * r.direction()[2];
-
-        ray rotated_r(origin, direction, r.time());
+        ray rotated_r(to_object(r.origin()), to_object(r.direction()), r.time(), r.spread());
 
         // Determine where (If any) an intersection occurs in object space
         if (!object->hit(rotated_r, ray_t, rec)) return false;
 
-        // Change the intersection point from object space to world space
-        point3 p = rec.p;
-        p[0] =  cos_theta * rec.p[0] + sin_theta * rec.p[2];
-        p[2] = -sin_theta * rec.p[0] + cos_theta * rec.p[2];
-
-        // Change the normal from object space to world space
-        vec3 normal = rec.normal;
-        normal[0] =  cos_theta * rec.normal[0] + sin_theta * rec.normal[2];
-        normal[2] = -sin_theta * rec.normal[0] + cos_theta * rec.normal[2];
-
-        rec.p = p;
-        rec.normal = normal;
+        // Change the intersection point and normal from object space to world space
+        rec.p = to_world(rec.p);
+        rec.normal = to_world(rec.normal);
 
         return true;
     }
 
     aabb bounding_box() const override { return bbox; }
 
+    // A rotated light is sampled in object space, like a ray is intersected
+    double pdf_value(const point3& origin, const vec3& direction) const override {
+        return object->pdf_value(to_object(origin), to_object(direction));
+    }
+
+    vec3 random(const point3& origin) const override {
+        return to_world(object->random(to_object(origin)));
+    }
+
+    light_bounds emission_bounds() const override {
+        light_bounds lb = object->emission_bounds();
+        lb.bounds = rotated(lb.bounds);
+        lb.w = to_world(lb.w);
+        return lb;
+    }
+
+    double transmittance(const ray& r, interval ray_t) const override {
+        return object->transmittance(ray(to_object(r.origin()), to_object(r.direction()), r.time(), r.spread()), ray_t);
+    }
+
 private:
     shared_ptr<hittable> object;
     double sin_theta;
     double cos_theta;
     aabb bbox;
+
+    vec3 to_object(vec3 v) const {
+        return vec3(cos_theta * v[0] - sin_theta * v[2], v[1], sin_theta * v[0] + cos_theta * v[2]);
+    }
+
+    vec3 to_world(vec3 v) const {
+        return vec3(cos_theta * v[0] + sin_theta * v[2], v[1], -sin_theta * v[0] + cos_theta * v[2]);
+    }
+
+    // Box around an object space box turned into world space
+    aabb rotated(const aabb& box) const {
+        point3 min( infinity,  infinity,  infinity);
+        point3 max(-infinity, -infinity, -infinity);
+
+        for (int i = 0; i < 2; i++) {
+            for (int j = 0; j < 2; j++) {
+                for (int k = 0; k < 2; k++) {
+                    double x = i * box.x.max + (1-i) * box.x.min;
+                    double y = j * box.y.max + (1-j) * box.y.min;
+                    double z = k * box.z.max + (1-k) * box.z.min;
+
+                    vec3 tester = to_world(vec3(x, y, z));
+
+                    for (int c = 0; c < 3; c++) {
+                        min[c] = fmin(min[c], tester[c]);
+                        max[c] = fmax(max[c], tester[c]);
+
+                    }
+                }
+            }
+        }
+
+        return aabb(min, max);
+    }
 };
 
 #endif
\ No newline at end of file
@@ -21,7 +21,6 @@ public:
     void add(shared_ptr<hittable> object) {
         objects.push_back(object);
         bbox = aabb(bbox, object->bounding_box());
-        std::clog << objects.size() << std::endl; 
     }
 
     bool hit(const ray &r, interval ray_t, hit_record &rec) const override {
@@ -45,6 +44,33 @@ public:
 
     aabb bounding_box() const override { return bbox; }
 
+    double pdf_value(const point3& origin, const vec3& direction) const override {
+        // every object is picked with equal probability
+        double weight = 1.0 / objects.size();
+        double sum = 0.0;
+
+        for (const auto& object : objects) {
+            sum += weight * object->pdf_value(origin, direction);
+        }
+
+        return sum;
+    }
+
+    vec3 random(const point3& origin) const override {
+        int size = static_cast<int>(objects.size());
+        return objects[random_int(0, size-1)]->random(origin);
+    }
+
+    // Light gets through only as much as every object lets through
+    double transmittance(const ray& r, interval ray_t) const override {
+        double T = 1.0;
+        for (const auto& object : objects) {
+            T *= object->transmittance(r, ray_t);
+            if (T <= 0) return 0.0;
+        }
+        return T;
+    }
+
 private:
     aabb bbox;
 };
@@ -0,0 +1,72 @@
+#ifndef IMAGE_REGISTRY_H
+#define IMAGE_REGISTRY_H
+
+#include "rtweekend.h"
+#include "mipmap.h"
+#include "rtw_stb_image.h"
+#include "thread_pool.h"
+#include "trace.h"
+
+#include <cstdio>
+#include <future>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Process wide set of decoded images, keyed by resolved path.
+//
+// Every texture using the same file shares one immutable mip pyramid, and each
+// file is decoded once, on the shared thread pool, so a scene referencing many
+// images decodes them concurrently while the rest of the scene is being built.
+class image_registry {
+public:
+    typedef std::shared_future<shared_ptr<const mipmap>> pending_image;
+
+    static image_registry& global() {
+        static image_registry registry;
+        return registry;
+    }
+
+    pending_image load(const char* filename) {
+        std::string name(filename);
+        std::string path = resolve(filename);
+        const std::string& key = path.empty() ? name : path;  // missing files still only report once
+
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = images.find(key);
+        if (it != images.end()) return it->second;
+
+        pending_image image = thread_pool::global().submit([name, path]() -> shared_ptr<const mipmap> {
+            rtw_float_image decoded;
+            if (path.empty() || !decoded.load(path)) {
+                std::cerr << "ERROR: Could not load image file '" << name << "'.\n";
+                return make_shared<const mipmap>();
+            }
+            trace::span span("mipmap build", name);
+            return make_shared<const mipmap>(decoded.pixel_data(0, 0), decoded.width(), decoded.height());
+        }).share();
+
+        images[key] = image;
+        return image;
+    }
+
+private:
+    std::mutex mutex;
+    std::unordered_map<std::string, pending_image> images;
+
+    static std::string resolve(const char* filename) {
+        // first of the search locations where the file exists, without decoding anything
+        std::string found;
+        rtw_search_image(filename, [&found](const std::string& path) {
+            std::FILE* f = std::fopen(path.c_str(), "rb");
+            if (!f) return false;
+            std::fclose(f);
+            found = path;
+            return true;
+        });
+        return found;
+    }
+};
+
+#endif
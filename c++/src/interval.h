@@ -2,35 +2,36 @@
 #define INTERVAL_H
 
 #include "rtweekend.h"
+#include "precision.h"
 
 class interval {
 public:
-    double min, max;
+    real min, max;
 
     interval() : min(+infinity), max(-infinity) {}
-    interval(double _min, double _max) : min(_min), max(_max) {}
+    interval(real _min, real _max) : min(_min), max(_max) {}
     interval(const interval& a, const interval& b) : min(fmin(a.min, b.min)), max(fmax(a.max, b.max)) {}
 
-    bool contains(double x) const {  // open interval
+    bool contains(real x) const {  // open interval
         return min <= x && x <= max;
     }
 
-    bool surrounds(double x) const {  // closed interval
+    bool surrounds(real x) const {  // closed interval
         return min < x && x < max;
     }
 
-    double clamp(double x) const {
+    real clamp(real x) const {
         if (x < min) return min;
         if (x > max) return max;
         return x;
     }
 
-    double size() const {
+    real size() const {
         return max - min;
     }
 
-    interval expand(double delta) const {
-        double padding = delta / 2;
+    interval expand(real delta) const {
+        real padding = delta / 2;
         return interval(min - padding, max + padding);
     }
 
@@ -40,11 +41,11 @@ public:
 const static interval empty(+infinity, -infinity);
 const static interval universe(-infinity, +infinity);
 
-interval operator+(const interval& ival, double displacement) {
+interval operator+(const interval& ival, real displacement) {
     return interval(ival.min + displacement, ival.max + displacement);
 }
 
-interval operator+(double displacement, const interval& ival) {
+interval operator+(real displacement, const interval& ival) {
     return ival + displacement;
 }
 
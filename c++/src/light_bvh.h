@@ -0,0 +1,233 @@
+#ifndef LIGHT_BVH_H
+#define LIGHT_BVH_H
+
+#include "rtweekend.h"
+#include "hittable.h"
+#include "hittable_list.h"
+
+#include <algorithm>
+#include <vector>
+
+// Light Bounding Volume Hierarchy
+//
+// Picks a light stochastically in proportion to a conservative estimate of its
+// contribution at the shading point (power, distance and orientation of each
+// node's lights), rather than uniformly like hittable_list.  Sampling and
+// evaluating the pdf each walk a single root to leaf path (or the few paths a
+// direction can hit), so the cost grows logarithmically with the light count.
+class light_bvh : public hittable {
+public:
+    light_bvh(const hittable_list& list) {
+        std::vector<int> indices;
+
+        for (const auto& object : list.objects) {
+            light_bounds lb = object->emission_bounds();
+            if (lb.phi <= 0) continue;  // not an emitter
+
+            indices.push_back(static_cast<int>(lights.size()));
+            lights.push_back(object);
+            bounds.push_back(lb);
+        }
+
+        if (!indices.empty()) {
+            build(indices, 0, indices.size());
+        }
+    }
+
+    size_t size() const { return lights.size(); }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        if (nodes.empty()) return false;
+        return hit_node(0, r, ray_t, rec);
+    }
+
+    aabb bounding_box() const override {
+        return nodes.empty() ? aabb() : nodes[0].lb.bounds;
+    }
+
+    double pdf_value(const point3& origin, const vec3& direction) const override {
+        if (nodes.empty()) return 0;
+        return pdf_node(0, 1.0, origin, ray(origin, direction));
+    }
+
+    vec3 random(const point3& origin) const override {
+        if (nodes.empty()) return vec3(1,0,0);
+
+        int n = 0;
+        while (!nodes[n].is_leaf) {
+            double p_left = left_probability(n, origin);
+            n = (random_double() < p_left) ? n+1 : nodes[n].second_child;
+        }
+
+        return lights[nodes[n].light]->random(origin);
+    }
+
+private:
+    struct node {
+        light_bounds lb;
+        int second_child = -1;  // the first child directly follows its parent
+        int light = -1;
+        bool is_leaf = false;
+    };
+
+    std::vector<shared_ptr<hittable>> lights;
+    std::vector<light_bounds> bounds;
+    std::vector<node> nodes;
+
+    int build(std::vector<int>& indices, size_t start, size_t end) {
+        int index = static_cast<int>(nodes.size());
+        nodes.push_back(node());
+
+        if (end - start == 1) {
+            nodes[index].lb = bounds[indices[start]];
+            nodes[index].light = indices[start];
+            nodes[index].is_leaf = true;
+            return index;
+        }
+
+        // split at the median centroid along the widest axis
+        aabb centroids;
+        for (size_t i = start; i < end; i++) {
+            point3 c = centroid(bounds[indices[i]].bounds);
+            centroids = aabb(centroids, aabb(c, c));
+        }
+
+        int axis = 0;
+        if (centroids.y.size() > centroids.axis(axis).size()) axis = 1;
+        if (centroids.z.size() > centroids.axis(axis).size()) axis = 2;
+
+        size_t mid = start + (end - start)/2;
+        std::nth_element(indices.begin() + start, indices.begin() + mid, indices.begin() + end,
+            [&](int a, int b) {
+                return centroid(bounds[a].bounds)[axis] < centroid(bounds[b].bounds)[axis];
+            });
+
+        build(indices, start, mid);
+        int second = build(indices, mid, end);
+
+        nodes[index].second_child = second;
+        nodes[index].lb = merge(nodes[index+1].lb, nodes[second].lb);
+        return index;
+    }
+
+    bool hit_node(int n, const ray& r, interval ray_t, hit_record& rec) const {
+        interval node_t = ray_t;
+        if (!nodes[n].lb.bounds.hit(r, node_t)) return false;
+
+        if (nodes[n].is_leaf) {
+            return lights[nodes[n].light]->hit(r, ray_t, rec);
+        }
+
+        bool hit_left = hit_node(n+1, r, ray_t, rec);
+        bool hit_right = hit_node(nodes[n].second_child, r, interval(ray_t.min, hit_left ? rec.t : ray_t.max), rec);
+
+        return hit_left || hit_right;
+    }
+
+    double pdf_node(int n, double pmf, const point3& origin, const ray& r) const {
+        // only lights whose bounds the direction passes through can have generated it
+        if (pmf <= 0) return 0;
+
+        interval ray_t(r.min_t(), infinity);
+        if (!nodes[n].lb.bounds.hit(r, ray_t)) return 0;
+
+        if (nodes[n].is_leaf) {
+            return pmf * lights[nodes[n].light]->pdf_value(origin, r.direction());
+        }
+
+        double p_left = left_probability(n, origin);
+        return pdf_node(n+1, pmf * p_left, origin, r)
+             + pdf_node(nodes[n].second_child, pmf * (1 - p_left), origin, r);
+    }
+
+    double left_probability(int n, const point3& p) const {
+        double left = importance(nodes[n+1].lb, p);
+        double right = importance(nodes[nodes[n].second_child].lb, p);
+
+        if (left + right <= 0) return 0.5;  // neither side can be told apart, so don't favour either
+        return left / (left + right);
+    }
+
+    static double importance(const light_bounds& lb, const point3& p) {
+        // Upper bound style estimate of the light's contribution at p
+        point3 pc = centroid(lb.bounds);
+        vec3 diagonal(lb.bounds.x.size(), lb.bounds.y.size(), lb.bounds.z.size());
+
+        double d2 = (p - pc).length_squared();
+        double d2_clamped = fmax(d2, diagonal.length() / 2);  // avoid blowing up close to (or inside) the bounds
+
+        // angle between the central normal and the direction to p
+        vec3 wi = d2 > 0 ? (p - pc) / sqrt(d2) : lb.w;
+        double cos_theta_w = dot(lb.w, wi);
+        if (lb.two_sided) cos_theta_w = fabs(cos_theta_w);
+        double sin_theta_w = safe_sqrt(1 - cos_theta_w*cos_theta_w);
+
+        // angle subtended by the bounds' bounding sphere as seen from p
+        double r2 = diagonal.length_squared() / 4;
+        double cos_theta_b = (d2 < r2) ? -1 : safe_sqrt(1 - r2/d2);
+        double sin_theta_b = safe_sqrt(1 - cos_theta_b*cos_theta_b);
+
+        // smallest angle between the emission cone and the direction to p: theta_w - theta_o - theta_b
+        double cos_theta_o = lb.cos_theta_o;
+        double sin_theta_o = safe_sqrt(1 - cos_theta_o*cos_theta_o);
+        double cos_theta_x = cos_sub_clamped(sin_theta_w, cos_theta_w, sin_theta_o, cos_theta_o);
+        double sin_theta_x = sin_sub_clamped(sin_theta_w, cos_theta_w, sin_theta_o, cos_theta_o);
+        double cos_theta_p = cos_sub_clamped(sin_theta_x, cos_theta_x, sin_theta_b, cos_theta_b);
+
+        if (cos_theta_p <= lb.cos_theta_e) return 0;
+
+        return lb.phi * cos_theta_p / d2_clamped;
+    }
+
+    static light_bounds merge(const light_bounds& a, const light_bounds& b) {
+        light_bounds lb;
+        lb.bounds = aabb(a.bounds, b.bounds);
+        lb.phi = a.phi + b.phi;
+        lb.cos_theta_e = fmin(a.cos_theta_e, b.cos_theta_e);
+        lb.two_sided = a.two_sided || b.two_sided;
+        merge_cones(a.w, a.cos_theta_o, b.w, b.cos_theta_o, lb.w, lb.cos_theta_o);
+        return lb;
+    }
+
+    static void merge_cones(const vec3& wa, double cos_a, const vec3& wb, double cos_b, vec3& w, double& cos_o) {
+        // smallest cone of directions containing both cones
+        double theta_a = acos(clamp_cos(cos_a));
+        double theta_b = acos(clamp_cos(cos_b));
+        double theta_d = acos(clamp_cos(dot(wa, wb)));
+
+        if (fmin(theta_d + theta_b, pi) <= theta_a) { w = wa; cos_o = cos_a; return; }
+        if (fmin(theta_d + theta_a, pi) <= theta_b) { w = wb; cos_o = cos_b; return; }
+
+        double theta_o = (theta_a + theta_d + theta_b) / 2;
+        vec3 axis = cross(wa, wb);
+        if (theta_o >= pi || axis.length_squared() == 0) { w = wa; cos_o = -1; return; }
+
+        // rotate wa towards wb by theta_r
+        double theta_r = theta_o - theta_a;
+        axis = unit_vector(axis);
+        w = unit_vector(cos(theta_r) * wa + sin(theta_r) * cross(axis, wa));
+        cos_o = cos(theta_o);
+    }
+
+    static point3 centroid(const aabb& box) {
+        return point3(0.5*(box.x.min + box.x.max), 0.5*(box.y.min + box.y.max), 0.5*(box.z.min + box.z.max));
+    }
+
+    static double cos_sub_clamped(double sin_a, double cos_a, double sin_b, double cos_b) {
+        // cos(max(0, a - b))
+        if (cos_a > cos_b) return 1;
+        return cos_a*cos_b + sin_a*sin_b;
+    }
+
+    static double sin_sub_clamped(double sin_a, double cos_a, double sin_b, double cos_b) {
+        // sin(max(0, a - b))
+        if (cos_a > cos_b) return 0;
+        return sin_a*cos_b - cos_a*sin_b;
+    }
+
+    static double safe_sqrt(double x) { return sqrt(fmax(0.0, x)); }
+
+    static double clamp_cos(double x) { return fmin(1.0, fmax(-1.0, x)); }
+};
+
+#endif
@@ -1,436 +1,133 @@
-#include "rtweekend.h"
-#include "camera.h"
-#include "color.h"
-#include "hittable_list.h"
-#include "material.h"
-#include "sphere.h"
-#include "bvh.h"
-#include "texture.h"
-#include "quad.h"
-#include "constant_medium.h"
-
-
-void debug_world() {
-    hittable_list world;
-
-    auto material_ground = make_shared<lambertian>(color(0.8, 0.8, 0.0));
-    auto material_center = make_shared<lambertian>(color(0.1, 0.2, 0.5));
-    auto material_left   = make_shared<dielectric>(1.5);
-    auto material_right  = make_shared<metal>(color(0.8, 0.6, 0.2), 0.0);
-
-    world.add(make_shared<sphere>(point3( 0.0, -100.5, -1.0), 100, material_ground));
-    world.add(make_shared<sphere>(point3( 0.0,    0.0, -1.0), 0.5, material_center));
-    world.add(make_shared<sphere>(point3(-1.2,    0.0, -1.0), 0.5, material_left));
-    world.add(make_shared<sphere>(point3(-1.0, 0.0, -1.0), -0.4, material_left));  // Negative radius leaves geometry the same, but makes the surface normal point inwards (used to make a hollow glass sphere)
-    world.add(make_shared<sphere>(point3( 1.0, 0.0, -1.0), 0.5, material_right));
-
-    camera cam;
-    cam.aspect_ratio      = 16.0 / 9.0;
-    cam.image_width       = 400;
-    cam.samples_per_pixel = 100;
-    cam.max_depth         = 50;
-    cam.background        = color(0.7, 0.8, 1.0);
-
-    cam.vfov     = 20;
-    cam.lookfrom = point3(-2, 2, 1);
-    cam.lookat   = point3(0,0,-1);
-    cam.vup      = vec3(0,1,0);
-
-    cam.defocus_angle = 10.0;
-    cam.focus_dist    = 3.4;
-
-    cam.render(world);    
+#include "distributed.h"
+#include "render_server.h"
+#include "scene_loader.h"
+#include "scenes.h"
+
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+
+const int selected = 0;
+
+scene selected_scene() {
+    trace::span span("scene construction");
+    switch (selected) {
+        case 1: return random_spheres();
+        case 2: return two_spheres();
+        case 3: return earth();
+        case 4: return two_perlin_spheres();
+        case 5: return quads();
+        case 6: return simple_light();
+        case 7: return cornell_box();
+        case 8: return cornell_smoke();
+        case 9: return final_scene(800, 10000, 40);
+        case 10: return many_lights();
+        case 11: return cornell_perlin_smoke();
+        case 12: return environment_lit();
+        default: return final_scene(400, 200, 4);
+    }
 }
 
-
-void random_spheres() {
-    hittable_list world;
-
-    auto checker = make_shared<checker_texture>(0.32, color(.2, .3, .1), color(.9, .9, .9));
-    auto ground_material = make_shared<lambertian>(checker);
-    world.add(make_shared<sphere>(point3(0, -1000, 0), 1000, ground_material));
-
-    for (int a = -11; a < 11; a++) {
-        for (int b = -11; b < 11; b++) {
-            auto choose_mat = random_double();
-            point3 center(a + 0.9*random_double(), 0.2, b + 0.9*random_double());
-
-            if ((center - point3(4, 0.2, 0)).length() > 0.9) {
-                shared_ptr<material> sphere_material;
-
-                if (choose_mat < 0.8) {
-                    // diffuse
-                    auto albedo = color::random() * color::random();
-                    sphere_material = make_shared<lambertian>(albedo);
-                    vec3 center2 = center + vec3(0, random_double(0, .5), 0);
-                    world.add(make_shared<sphere>(center, center2, 0.2, sphere_material));
-                } else if (choose_mat < 0.95) {
-                    // metal
-                    auto albedo = color::random(0.5, 1);
-                    auto fuzz = random_double(0, 0.5);
-                    sphere_material = make_shared<metal>(albedo, fuzz);
-                    world.add(make_shared<sphere>(center, 0.2, sphere_material));
-                } else {
-                    // glass
-                    sphere_material = make_shared<dielectric>(1.5);
-                    world.add(make_shared<sphere>(center, 0.2, sphere_material));
-                }
-            }
+// Takes render jobs until told to quit (see render_server.h)
+int serve(int argc, char* argv[]) {
+    std::string socket_path;
+    int threads = static_cast<int>(std::thread::hardware_concurrency());
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--socket" && i + 1 < argc) socket_path = argv[++i];
+        else if (arg == "--threads" && i + 1 < argc) threads = std::atoi(argv[++i]);
+        else {
+            std::cerr << "ERROR: Unknown server option '" << arg << "'.\n";
+            return 2;
         }
     }
 
-    // ray r()
-
-    auto material1 = make_shared<dielectric>(1.5);
-    world.add(make_shared<sphere>(point3(0, 1, 0), 1.0, material1));
-
-    auto material2 = make_shared<lambertian>(color(0.4, 0.2, 0.1));
-    world.add(make_shared<sphere>(point3(-4, 1, 0), 1.0, material2));
-
-    auto material3 = make_shared<metal>(color(0.7, 0.6, 0.5), 0.0);
-    world.add(make_shared<sphere>(point3(4, 1, 0), 1.0, material3));
-
-    world = hittable_list(make_shared<bvh_node>(world));
-
-    camera cam;
-    cam.aspect_ratio      = 16.0 / 9.0;
-    cam.image_width       = 400;  // increase to 1200 for final render
-    cam.samples_per_pixel = 100;  // increase to 500 for final render
-    cam.max_depth         = 50;
-    cam.background        = color(0.7, 0.8, 1.0);
-
-    cam.vfov     = 20;
-    cam.lookfrom = point3(13, 2, 3);
-    cam.lookat   = point3(0,0,0);
-    cam.vup      = vec3(0,1,0);
-
-    cam.defocus_angle = 0.6;
-    cam.focus_dist    = 10.0;
-
-    cam.render(world);
-}
-
-
-void two_spheres() {
-    hittable_list world;
-
-    auto checker = make_shared<checker_texture>(0.32, color(.2, .3, .1), color(.9, .9, .9));
-
-    world.add(make_shared<sphere>(point3(0,-10,0), 10, make_shared<lambertian>(checker)));
-    world.add(make_shared<sphere>(point3(0, 10,0), 10, make_shared<lambertian>(checker)));
-
-    camera cam;
-    cam.aspect_ratio      = 16.0 / 9.0;
-    cam.image_width       = 400;  // increase to 1200 for final render
-    cam.samples_per_pixel = 100;  // increase to 500 for final render
-    cam.max_depth         = 50;
-    cam.background        = color(0.7, 0.8, 1.0);
-
-    cam.vfov     = 20;
-    cam.lookfrom = point3(13, 2, 3);
-    cam.lookat   = point3(0,0,0);
-    cam.vup      = vec3(0,1,0);
-
-    cam.defocus_angle = 0.6;
-    cam.focus_dist    = 10.0;
-
-    cam.render(world);
-}
-
-
-void earth() {
-    auto earth_texture = make_shared<image_texture>("earthmap.gif");
-    auto earth_surface = make_shared<lambertian>(earth_texture);
-    auto globe = make_shared<sphere>(point3(0,0,0), 2, earth_surface);
-
-    camera cam;
-    cam.aspect_ratio      = 16.0 / 9.0;
-    cam.image_width       = 800;  // increase to 1200 for final render
-    cam.samples_per_pixel = 100;  // increase to 500 for final render
-    cam.max_depth         = 50;
-    cam.background        = color(0.7, 0.8, 1.0);
-
-    cam.vfov     = 20;
-    cam.lookfrom = point3(0, 0, 12);
-    cam.lookat   = point3(0,0,0);
-    cam.vup      = vec3(0,1,0);
-
-    cam.defocus_angle = 0;
-
-    cam.render(hittable_list(globe));
-}
-
-
-void two_perlin_spheres() {
-    hittable_list world;
-
-    auto pertext = make_shared<noise_texture>(1);
-    world.add(make_shared<sphere>(point3(0,-1000,0), 1000, make_shared<lambertian>(pertext)));
-    world.add(make_shared<sphere>(point3(0, 2,0), 2, make_shared<lambertian>(pertext)));
-
-    camera cam;
-    cam.aspect_ratio      = 16.0 / 9.0;
-    cam.image_width       = 400;  // increase to 1200 for final render
-    cam.samples_per_pixel = 100;  // increase to 500 for final render
-    cam.max_depth         = 50;
-    cam.background        = color(0.7, 0.8, 1.0);
-
-    cam.vfov     = 20;
-    cam.lookfrom = point3(13, 2, 3);
-    cam.lookat   = point3(0,0,0);
-    cam.vup      = vec3(0,1,0);
-
-    cam.defocus_angle = 0;
-
-    cam.render(hittable_list(world));
-}
-
-
-void quads() {
-    hittable_list world;
-
-    // Materials
-    auto left_red     = make_shared<lambertian>(color(1.0, 0.2, 0.2));
-    auto back_green   = make_shared<lambertian>(color(0.2, 1.0, 0.2));
-    auto right_blue   = make_shared<lambertian>(color(0.2, 0.2, 1.0));
-    auto upper_orange = make_shared<lambertian>(color(1.0, 0.5, 0.0));
-    auto lower_teal   = make_shared<lambertian>(color(0.2, 0.8, 0.8));
-
-    // Quads
-    world.add(make_shared<quad>(point3(-3,-2, 5), vec3(0, 0,-4), vec3(0, 4, 0), left_red));
-    world.add(make_shared<quad>(point3(-2,-2, 0), vec3(4, 0, 0), vec3(0, 4, 0), back_green));
-    world.add(make_shared<quad>(point3( 3,-2, 1), vec3(0, 0, 4), vec3(0, 4, 0), right_blue));
-    world.add(make_shared<quad>(point3(-2, 3, 1), vec3(4, 0, 0), vec3(0, 0, 4), upper_orange));
-    world.add(make_shared<quad>(point3(-2,-3, 5), vec3(4, 0, 0), vec3(0, 0,-4), lower_teal));
-
-    camera cam;
-    cam.aspect_ratio      = 1.0;
-    cam.image_width       = 200;  // increase to 1200 for final render
-    cam.samples_per_pixel = 100;  // increase to 500 for final render
-    cam.max_depth         = 50;
-    cam.background        = color(0.7, 0.8, 1.0);
-
-    cam.vfov     = 80;
-    cam.lookfrom = point3(0,0,9);
-    cam.lookat   = point3(0,0,0);
-    cam.vup      = vec3(0,1,0);
-
-    cam.defocus_angle = 0;
-
-    cam.render(world);
+    std::clog.rdbuf(nullptr);  // the jobs' progress would interleave
+    render_server server(threads);
+    if (socket_path.empty()) server.serve_stdio();
+    else if (!server.serve_socket(socket_path)) return 1;
+    return 0;
 }
 
+// Renders one frame on worker processes (see distributed.h)
+int distribute(int argc, char* argv[]) {
+    distributed_settings settings;
+    settings.program = argv[0];
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        bool value = i + 1 < argc;
+        if (arg == "--workers" && value) settings.workers = std::atoi(argv[++i]);
+        else if (arg == "--listen" && value) settings.port = std::atoi(argv[++i]);
+        else if (arg == "--tile" && value) settings.tile_size = std::atoi(argv[++i]);
+        else if (arg == "--width" && value) settings.width = std::atoi(argv[++i]);
+        else if (arg == "--spp" && value) settings.spp = std::atoi(argv[++i]);
+        else if (arg == "--seed" && value) settings.seed = static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--accumulation" && value) settings.accumulation = argv[++i];
+        else if (arg.compare(0, 2, "--") != 0 && settings.scene.empty()) settings.scene = arg;
+        else {
+            std::cerr << "ERROR: Unknown option '" << arg << "'.\n";
+            return 2;
+        }
+    }
+    if (settings.scene.empty()) {
+        std::cerr << "ERROR: No scene to distribute.\n";
+        return 2;
+    }
 
-void simple_light() {
-    hittable_list world;
-
-    auto pertext = make_shared<noise_texture>(4);
-    world.add(make_shared<sphere>(point3(0, -1000, 0), 1000, make_shared<lambertian>(pertext)));
-    world.add(make_shared<sphere>(point3(0, 2, 0), 2, make_shared<lambertian>(pertext)));
-
-    auto difflight = make_shared<diffuse_light>(color(4,4,4));
-    world.add(make_shared<quad>(point3(3,1,-2), vec3(2,0,0), vec3(0,2,0), difflight));
-    world.add(make_shared<sphere>(point3(0,7,0), 2, difflight));
-
-    camera cam;
-    cam.aspect_ratio      = 16.0 / 9.0;
-    cam.image_width       = 400;  // increase to 1200 for final render
-    cam.samples_per_pixel = 100;  // increase to 500 for final render
-    cam.max_depth         = 50;
-    cam.background        = color(0,0,0);
-
-    cam.vfov     = 20;
-    cam.lookfrom = point3(26, 3, 6);
-    cam.lookat   = point3(0,2,0);
-    cam.vup      = vec3(0,1,0);
-
-    cam.defocus_angle = 0;
-
-    cam.render(world);
-}
-
-
-void cornell_box() {
-    hittable_list world;
-
-    auto red   = make_shared<lambertian>(color(.65, .05, .05));
-    auto white = make_shared<lambertian>(color(.73, .73, .73));
-    auto green = make_shared<lambertian>(color(.12, .45, .15));
-    auto light = make_shared<diffuse_light>(color(15, 15, 15));
-
-    world.add(make_shared<quad>(point3(555, 0, 0), vec3(0, 555, 0), vec3(0,0,555), green));
-    world.add(make_shared<quad>(point3(0, 0, 0), vec3(0, 555, 0), vec3(0,0,555), red));
-    world.add(make_shared<quad>(point3(343, 554, 332), vec3(-130, 0, 0), vec3(0,0,-105), light));
-    world.add(make_shared<quad>(point3(0,0,0), vec3(555, 0, 0), vec3(0,0,555), white));
-    world.add(make_shared<quad>(point3(555,555,555), vec3(-555, 0, 0), vec3(0,0,-555), white));
-    world.add(make_shared<quad>(point3(0,0,555), vec3(555, 0, 0), vec3(0,555,0), white));
-
-    shared_ptr<hittable> box1 = box(point3(0,0,0), point3(165, 330, 165), white);
-    box1 = make_shared<rotate_y>(box1, 15);
-    box1 = make_shared<translate>(box1, vec3(265,0,295));
-    world.add(box1);
-
-    shared_ptr<hittable> box2 = box(point3(0,0,0), point3(165, 165, 165), white);
-    box1 = make_shared<rotate_y>(box1, -18);
-    box1 = make_shared<translate>(box1, vec3(130,0,65));
-    world.add(box2);
-
-    camera cam;
-    cam.aspect_ratio      = 1.0;
-    cam.image_width       = 200;  // increase to 1200 for final render
-    cam.samples_per_pixel = 200;  // increase to 500 for final render
-    cam.max_depth         = 50;
-    cam.background        = color(0,0,0);
-
-    cam.vfov     = 40;
-    cam.lookfrom = point3(278, 278, -800);
-    cam.lookat   = point3(278, 278, 0);
-    cam.vup      = vec3(0,1,0);
-
-    cam.defocus_angle = 0;
-
-    cam.render(world);
-}
-
-
-void cornell_smoke() {
-    hittable_list world;
-
-    auto red   = make_shared<lambertian>(color(.65, .05, .05));
-    auto white = make_shared<lambertian>(color(.73, .73, .73));
-    auto green = make_shared<lambertian>(color(.12, .45, .15));
-    auto light = make_shared<diffuse_light>(color(7, 7, 7));
-
-    world.add(make_shared<quad>(point3(555, 0, 0), vec3(0, 555, 0), vec3(0,0,555), green));
-    world.add(make_shared<quad>(point3(0, 0, 0), vec3(0, 555, 0), vec3(0,0,555), red));
-    world.add(make_shared<quad>(point3(113, 554, 127), vec3(330, 0, 0), vec3(0,0,305), light));
-    world.add(make_shared<quad>(point3(0,0,0), vec3(555, 0, 0), vec3(0,0,555), white));
-    world.add(make_shared<quad>(point3(555,555,555), vec3(-555, 0, 0), vec3(0,0,-555), white));
-    world.add(make_shared<quad>(point3(0,0,555), vec3(555, 0, 0), vec3(0,555,0), white));
-
-    shared_ptr<hittable> box1 = box(point3(0,0,0), point3(165, 330, 165), white);
-    box1 = make_shared<rotate_y>(box1, 15);
-    box1 = make_shared<translate>(box1, vec3(265,0,295));
-
-    shared_ptr<hittable> box2 = box(point3(0,0,0), point3(165, 165, 165), white);
-    box2 = make_shared<rotate_y>(box2, -18);
-    box2 = make_shared<translate>(box2, vec3(130,0,65));
-
-    world.add(make_shared<constant_medium>(box1, 0.01, color(0,0,0)));
-    world.add(make_shared<constant_medium>(box2, 0.01, color(1,1,1)));
-
-    camera cam;
-    cam.aspect_ratio      = 1.0;
-    cam.image_width       = 200;  // increase to 1200 for final render
-    cam.samples_per_pixel = 100;  // increase to 500 for final render
-    cam.max_depth         = 50;
-    cam.background        = color(0,0,0);
-
-    cam.vfov     = 40;
-    cam.lookfrom = point3(278, 278, -800);
-    cam.lookat   = point3(278,278,0);
-    cam.vup      = vec3(0,1,0);
-
-    cam.defocus_angle = 0;
-
-    cam.render(world);
+    coordinator c(settings);
+    return c.run(std::cout) ? 0 : 1;
 }
 
+// Renders a scene file (see scene_loader.h) or without one the scene picked above, or with --serve
+// takes render jobs, with --distribute renders on worker processes.  Options:
+//   --checkpoint FILE           keep the render's sums in FILE and resume from it (see camera.h)
+//   --checkpoint-interval S     seconds between checkpoints
+//   --seed N                    seed the samples (not the scene), so renders to merge differ
+int main(int argc, char* argv[]) {
+    if (argc > 1 && std::string(argv[1]) == "--serve") {
+        int status = serve(argc, argv);
+        trace::write();
+        return status;
+    }
+    if (argc > 1 && std::string(argv[1]) == "--distribute") {
+        int status = distribute(argc, argv);
+        trace::write();
+        return status;
+    }
+    if (argc > 1 && std::string(argv[1]) == "--worker") {
+        std::clog.rdbuf(nullptr);  // every worker would log its scene load
+        return argc > 2 ? run_worker(argv[2]) : run_worker(0, 1);
+    }
 
-void final_scene(int image_width, int samples_per_pixel, int max_depth) {
-    hittable_list boxes1;
-    auto ground = make_shared<lambertian>(color(0.48, 0.83, 0.53));
-
-    int boxes_per_side = 20;
-    for (int i = 0; i < boxes_per_side; i++) {
-        for (int j = 0; j < boxes_per_side; j++) {
-            double w = 100.0;
-            double x0 = -1000.0 + i*w;
-            double z0 = -1000.0 + j*w;
-            double y0 = 0.0;
-
-            double x1 = x0 + w;
-            double y1 = random_double(1, 101);
-            double z1 = z0 + w;
-
-            boxes1.add(make_shared<bvh_node>(box(point3(x0,y0,z0), point3(x1, y1, z1), ground)));
+    std::string scene_file, checkpoint;
+    double checkpoint_interval = 0;
+    bool seeded = false;
+    unsigned int seed = 0;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--checkpoint" && i + 1 < argc) checkpoint = argv[++i];
+        else if (arg == "--checkpoint-interval" && i + 1 < argc) checkpoint_interval = std::atof(argv[++i]);
+        else if (arg == "--seed" && i + 1 < argc) {
+            seed = static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10));
+            seeded = true;
+        } else if (arg.compare(0, 2, "--") != 0 && scene_file.empty()) scene_file = arg;
+        else {
+            std::cerr << "ERROR: Unknown option '" << arg << "'.\n";
+            return 2;
         }
     }
 
-    hittable_list world;
-
-    world.add(make_shared<bvh_node>(boxes1));
-
-    auto light = make_shared<diffuse_light>(color(7,7,7));
-    world.add(make_shared<quad>(point3(123,554,147), vec3(300,0,0), vec3(0,0,265), light));
-
-    // Moving sphere
-    auto center1 = point3(400, 400, 200);
-    auto center2 = center1 + vec3(30, 0, 0);
-    auto sphere_material = make_shared<lambertian>(color(0.7, 0.3, 0.1));
-    world.add(make_shared<sphere>(center1, center2, 50, sphere_material));
-
-    world.add(make_shared<sphere>(point3(260, 150, 45), 50, make_shared<dielectric>(1.5)));
-    world.add(make_shared<sphere>(point3(0, 150, 145), 50, make_shared<metal>(color(0.8, 0.8, 0.8), 1.0)));
-
-    auto boundary = make_shared<sphere>(point3(360, 150, 145), 70, make_shared<dielectric>(1.5));
-    world.add(boundary);
-    world.add(make_shared<constant_medium>(boundary, 0.2, color(0.2, 0.4, 0.9)));
-
-    boundary = make_shared<sphere>(point3(0,0,0), 5000, make_shared<dielectric>(1.5));
-    world.add(make_shared<constant_medium>(boundary, .0001, color(1,1,1)));
-
-    // Earth globe
-    auto emat = make_shared<lambertian>(make_shared<image_texture>("earthmap.png"));
-    world.add(make_shared<sphere>(point3(400,200,400), 100, emat));
-
-    auto pertext = make_shared<noise_texture>(0.1);
-    world.add(make_shared<sphere>(point3(220,280,300), 80, make_shared<lambertian>(pertext)));
-
-
-    hittable_list boxes2;
-    auto white = make_shared<lambertian>(color(.73,.73,.73));
-    int ns = 1000;
-    for (int i = 0; i < ns; i++) {
-        boxes2.add(make_shared<sphere>(point3::random(0,165), 10, white));
+    shared_ptr<scene> s = scene_file.empty() ? make_shared<scene>(selected_scene()) : load_scene(scene_file);
+    if (!s) return 1;
+    if (scene_file.empty()) {
+        std::string source = "selected scene " + std::to_string(selected);
+        s->cam.scene_hash = fnv1a(source.data(), source.size());
     }
+    if (!checkpoint.empty()) s->cam.checkpoint = checkpoint;
+    if (checkpoint_interval > 0) s->cam.checkpoint_interval = checkpoint_interval;
+    if (seeded) seed_random(seed);
 
-    world.add(make_shared<translate>(
-        make_shared<rotate_y>(
-            make_shared<bvh_node>(boxes2)
-            , 15)
-        , vec3(-100, 270, 395)));
-
-
-    camera cam;
-    cam.aspect_ratio      = 1.0;
-    cam.image_width       = image_width;  // increase to 1200 for final render
-    cam.samples_per_pixel = samples_per_pixel;  // increase to 500 for final render
-    cam.max_depth         = max_depth;
-    cam.background        = color(0,0,0);
-
-    cam.vfov     = 40;
-    cam.lookfrom = point3(478, 278, -600);
-    cam.lookat   = point3(278,278,0);
-    cam.vup      = vec3(0,1,0);
-
-    cam.defocus_angle = 0;
-
-    cam.render(world);
+    s->render();
+    trace::write();
 }
-
-
-int main() {
-    switch (0) {
-        case 1: random_spheres(); break;
-        case 2: two_spheres(); break;
-        case 3: earth(); break;
-        case 4: two_perlin_spheres(); break;
-        case 5: quads(); break;
-        case 6: simple_light(); break;
-        case 7: cornell_box(); break;
-        case 8: cornell_smoke(); break;
-        case 9: final_scene(800, 10000, 40); break;
-        default: final_scene(400, 200, 4); break;
-    }
-}
\ No newline at end of file
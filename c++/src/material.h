@@ -2,19 +2,49 @@
 #define MATERIAL_H
 
 #include "rtweekend.h"
+#include "fast_math.h"
+#include "stats.h"
 #include "texture.h"
 
+#include <atomic>
+
 class hit_record;
 
 class material {
 public:
+    material() : mat_id(next_id()) {}
     virtual ~material() = default;
 
+    int id() const { return mat_id; }  // unique per material instance
+
     virtual bool scatter(const ray &r_in, const hit_record &rec, color &attenuation, ray &scattered) const = 0;
 
     virtual color emitted(double u, double v, const point3& p) const {
         return color(0,0,0);
     }
+
+    // Density of `scatter` producing the direction of `scattered`.
+    // Zero for materials whose scattering cannot be mixed with light sampling (e.g. specular)
+    virtual double scattering_pdf(const ray& r_in, const hit_record& rec, const ray& scattered) const {
+        return 0;
+    }
+
+    // Reflectance at the hit, ignoring lighting (albedo AOV)
+    virtual color albedo_at(const hit_record& rec) const {
+        return color(1,1,1);
+    }
+
+    // True for the phase function of a participating medium, where the camera samples the lights
+    // with shadow rays
+    virtual bool volumetric() const { return false; }
+
+private:
+    int mat_id;
+
+    static int next_id() {
+        static std::atomic<int> counter(0);
+        return counter++;
+    }
 };
 
 
@@ -24,6 +54,7 @@ public:
     lambertian(shared_ptr<texture> a) : albedo(a) {}
 
     bool scatter(const ray &r_in, const hit_record &rec, color &attenuation, ray &scattered) const override {
+        RTW_STAT(scatter_calls[stat_lambertian]);
         vec3 scatter_direction = rec.normal + random_unit_vector();
 
         if (scatter_direction.near_zero()) {  // catch when rec.normal = -random_unit_vector() (i.e. scatter direction is zero)
@@ -31,10 +62,20 @@ public:
         }
 
         scattered = ray(rec.p, scatter_direction, r_in.time());
-        attenuation = albedo->value(rec.u, rec.v, rec.p);
+        attenuation = albedo->value(rec.u, rec.v, rec.p, rec.uv_width);
         return true;
     }
 
+    double scattering_pdf(const ray& r_in, const hit_record& rec, const ray& scattered) const override {
+        // normal + random_unit_vector() is cosine distributed about the normal
+        double cos_theta = dot(rec.normal, unit_vector(scattered.direction()));
+        return cos_theta < 0 ? 0 : cos_theta/pi;
+    }
+
+    color albedo_at(const hit_record& rec) const override {
+        return albedo->value(rec.u, rec.v, rec.p, rec.uv_width);
+    }
+
 private:
     shared_ptr<texture> albedo;
 };
@@ -45,12 +86,17 @@ public:
     metal(shared_ptr<texture> a, double f) : albedo(a), fuzz(f<1 ? f : 1) {} // don't allow the fuzz factor to be > 1
 
     bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered) const override {
+        RTW_STAT(scatter_calls[stat_metal]);
         vec3 reflected = reflect(unit_vector(r_in.direction()), rec.normal);
         scattered = ray(rec.p, reflected + fuzz*random_unit_vector(), r_in.time());
-        attenuation = albedo->value(rec.u, rec.v, rec.p);
+        attenuation = albedo->value(rec.u, rec.v, rec.p, rec.uv_width);
         return (dot(scattered.direction(), rec.normal) > 0); // only scatter if the scattered direction of outwards from the surface after fuzzing
     }
 
+    color albedo_at(const hit_record& rec) const override {
+        return albedo->value(rec.u, rec.v, rec.p, rec.uv_width);
+    }
+
 private:
     shared_ptr<texture> albedo;
     double fuzz;
@@ -61,6 +107,7 @@ public:
     dielectric(double index_of_refraction) : ir(index_of_refraction) {}
 
     bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered) const override {
+        RTW_STAT(scatter_calls[stat_dielectric]);
         attenuation = color(1.0, 1.0, 1.0);
         double refraction_ratio = rec.front_face ? (1.0/ir) : ir;
 
@@ -88,7 +135,7 @@ private:
         // Schlick's approximation of reflectance
         double r0 = (1.0-ref_idx) / (1.0+ref_idx);
         r0 = r0*r0;
-        return r0 + (1.0-r0)*pow(1.0-cosine, 5);
+        return r0 + (1.0-r0)*rtw_pow5(1.0-cosine);
     }
 };
 
@@ -100,6 +147,7 @@ public:
     diffuse_light(color c) : emit(make_shared<solid_color>(c)) {}
 
     bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered) const override {
+        RTW_STAT(scatter_calls[stat_diffuse_light]);
         return false;
     }
 
@@ -107,6 +155,10 @@ public:
         return emit->value(u, v, p);
     }
 
+    color albedo_at(const hit_record& rec) const override {
+        return emit->value(rec.u, rec.v, rec.p, rec.uv_width);
+    }
+
 private:
     shared_ptr<texture> emit;
 };
@@ -118,11 +170,22 @@ public:
     isotropic(shared_ptr<texture> a) : albedo(a) {}
 
     bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered) const override {
+        RTW_STAT(scatter_calls[stat_isotropic]);
         scattered = ray(rec.p, random_unit_vector(), r_in.time());
-        attenuation = albedo->value(rec.u, rec.v, rec.p);
+        attenuation = albedo->value(rec.u, rec.v, rec.p, rec.uv_width);
         return true;
     }
 
+    double scattering_pdf(const ray& r_in, const hit_record& rec, const ray& scattered) const override {
+        return 1 / (4*pi);
+    }
+
+    color albedo_at(const hit_record& rec) const override {
+        return albedo->value(rec.u, rec.v, rec.p, rec.uv_width);
+    }
+
+    bool volumetric() const override { return true; }
+
 private:
     shared_ptr<texture> albedo;
 };
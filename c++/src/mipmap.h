@@ -0,0 +1,163 @@
+#ifndef MIPMAP_H
+#define MIPMAP_H
+
+#include "rtweekend.h"
+
+#include <algorithm>
+#include <vector>
+
+// Bilinear filter of the texels texel(x, y) of a w x h image at (u,v) in [0,1]^2
+template <typename Fetch>
+color bilinear_filter(Fetch texel, int w, int h, double u, double v) {
+    // texel centres sit at half integer coordinates
+    double x = interval(0, 1).clamp(u) * w - 0.5;
+    double y = interval(0, 1).clamp(v) * h - 0.5;
+    int x0 = static_cast<int>(std::floor(x));
+    int y0 = static_cast<int>(std::floor(y));
+    double fx = x - x0;
+    double fy = y - y0;
+
+    return (1-fx) * (1-fy) * texel(x0, y0)   + fx * (1-fy) * texel(x0+1, y0)
+         + (1-fx) * fy     * texel(x0, y0+1) + fx * fy     * texel(x0+1, y0+1);
+}
+
+// Continuous mip level for a footprint uv_width wide on a w x h base level
+inline double mip_level(double uv_width, int w, int h) {
+    return (uv_width > 0) ? std::log2(uv_width * std::max(w, h)) : 0;
+}
+
+// Pyramid of successively half resolution copies of a linear RGB image.
+//
+// Each level is stored in 8x8 texel tiles, texels within a tile in Morton
+// (Z) order, so the four texels of a bilinear lookup, and lookups close to
+// each other on the surface, usually share a cache line or two instead of
+// striding across whole scanlines.
+class mipmap {
+public:
+    static const int tile_size = 8;
+
+    mipmap() {}
+
+    // rgb holds width*height linear RGB texels, rows top to bottom
+    mipmap(const float* rgb, int width, int height) {
+        if (width <= 0 || height <= 0) return;
+
+        std::vector<float> level_rgb(rgb, rgb + static_cast<size_t>(width) * height * 3);
+        while (true) {
+            levels.push_back(level(level_rgb, width, height));
+            if (width == 1 && height == 1) break;
+
+            level_rgb = downsample(level_rgb, width, height);
+            width = std::max(1, (width + 1) / 2);
+            height = std::max(1, (height + 1) / 2);
+        }
+    }
+
+    int width() const { return levels.empty() ? 0 : levels[0].width; }
+    int height() const { return levels.empty() ? 0 : levels[0].height; }
+    int level_count() const { return static_cast<int>(levels.size()); }
+
+    // Trilinearly filtered lookup of a footprint `uv_width` wide, (u,v) in [0,1]^2 with v = 0 at the top row
+    color sample(double u, double v, double uv_width) const {
+        if (levels.empty()) return color(0,1,1);
+
+        double lod = mip_level(uv_width, width(), height());
+        if (lod <= 0) return levels[0].bilinear(u, v);
+
+        int last = level_count() - 1;
+        if (lod >= last) return levels[last].bilinear(u, v);
+
+        int l = static_cast<int>(lod);
+        double t = lod - l;
+        return (1-t) * levels[l].bilinear(u, v) + t * levels[l+1].bilinear(u, v);
+    }
+
+    color texel(int lvl, int x, int y) const {
+        return levels[lvl].texel(x, y);
+    }
+
+    // Next level down of a w x h row-major RGB image, ((w+1)/2) x ((h+1)/2) texels
+    static std::vector<float> downsample(const std::vector<float>& rgb, int w, int h) {
+        // Box filter each output texel over the exact span of input texels it covers (1 to 2 texels per
+        // axis, fractional at odd sizes), so the pyramid keeps the image's average brightness
+        int nw = std::max(1, (w + 1) / 2);
+        int nh = std::max(1, (h + 1) / 2);
+
+        std::vector<float> rows(static_cast<size_t>(nw) * h * 3, 0.0f);
+        for (int x = 0; x < nw; x++) {
+            double x0 = static_cast<double>(x) * w / nw, x1 = static_cast<double>(x + 1) * w / nw;
+            for (int sx = static_cast<int>(x0); sx < x1 && sx < w; sx++) {
+                float weight = static_cast<float>((std::min(x1, sx + 1.0) - std::max(x0, static_cast<double>(sx))) / (x1 - x0));
+                for (int y = 0; y < h; y++) {
+                    for (int c = 0; c < 3; c++) {
+                        rows[(static_cast<size_t>(y)*nw + x) * 3 + c] += weight * rgb[(static_cast<size_t>(y)*w + sx) * 3 + c];
+                    }
+                }
+            }
+        }
+
+        std::vector<float> out(static_cast<size_t>(nw) * nh * 3, 0.0f);
+        for (int y = 0; y < nh; y++) {
+            double y0 = static_cast<double>(y) * h / nh, y1 = static_cast<double>(y + 1) * h / nh;
+            for (int sy = static_cast<int>(y0); sy < y1 && sy < h; sy++) {
+                float weight = static_cast<float>((std::min(y1, sy + 1.0) - std::max(y0, static_cast<double>(sy))) / (y1 - y0));
+                for (int x = 0; x < nw; x++) {
+                    for (int c = 0; c < 3; c++) {
+                        out[(static_cast<size_t>(y)*nw + x) * 3 + c] += weight * rows[(static_cast<size_t>(sy)*nw + x) * 3 + c];
+                    }
+                }
+            }
+        }
+        return out;
+    }
+
+private:
+    struct level {
+        int width, height;
+        int tiles_x;
+        std::vector<float> data;  // 3 floats per texel, tile after tile
+
+        level(const std::vector<float>& rgb, int w, int h) : width(w), height(h) {
+            tiles_x = (w + tile_size - 1) / tile_size;
+            int tiles_y = (h + tile_size - 1) / tile_size;
+            data.assign(static_cast<size_t>(tiles_x) * tiles_y * tile_size * tile_size * 3, 0.0f);
+
+            for (int y = 0; y < h; y++) {
+                for (int x = 0; x < w; x++) {
+                    std::copy_n(&rgb[(static_cast<size_t>(y)*w + x) * 3], 3, &data[offset(x, y)]);
+                }
+            }
+        }
+
+        size_t offset(int x, int y) const {
+            size_t tile = static_cast<size_t>(y / tile_size) * tiles_x + x / tile_size;
+            return (tile * tile_size * tile_size + morton(x % tile_size, y % tile_size)) * 3;
+        }
+
+        color texel(int x, int y) const {
+            x = std::min(width - 1, std::max(0, x));
+            y = std::min(height - 1, std::max(0, y));
+            const float* t = &data[offset(x, y)];
+            return color(t[0], t[1], t[2]);
+        }
+
+        color bilinear(double u, double v) const {
+            return bilinear_filter([this](int x, int y) { return texel(x, y); }, width, height, u, v);
+        }
+    };
+
+    std::vector<level> levels;
+
+    static int morton(int x, int y) {
+        // interleave the low three bits of x and y: y2 x2 y1 x1 y0 x0
+        int m = 0;
+        for (int b = 0; b < 3; b++) {
+            m |= ((x >> b) & 1) << (2*b);
+            m |= ((y >> b) & 1) << (2*b + 1);
+        }
+        return m;
+    }
+
+};
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
+// Calls f(i) for every i in [0, count) spread over the shared thread pool, returning once all are done.
+// The calling thread works through the indices too, so this never waits on a busy pool (or on itself,
+// when called from a pool task); helpers that only get to run afterwards find nothing left and return.
+template <typename F>
+void parallel_for(int count, F f) {
+    if (count <= 0) return;
+
+    struct progress {
+        std::atomic<int> next{0};
+        int finished = 0;
+        std::mutex mutex;
+        std::condition_variable all_finished;
+    };
+    auto state = std::make_shared<progress>();
+    F* body = &f;
+
+    auto worker = [state, body, count]() {
+        int n = 0;
+        for (int i = state->next++; i < count; i = state->next++, n++) {
+            (*body)(i);
+        }
+        if (n == 0) return;  // f may already be gone, don't touch it again
+
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->finished += n;
+        if (state->finished == count) state->all_finished.notify_all();
+    };
+
+    int helpers = std::min(thread_pool::global().size(), count - 1);
+    for (int t = 0; t < helpers; t++) {
+        thread_pool::global().submit(worker);
+    }
+    worker();
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->all_finished.wait(lock, [&]() { return state->finished == count; });
+}
+
+#endif
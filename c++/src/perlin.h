@@ -3,54 +3,75 @@
 
 #include "rtweekend.h"
 
-class perlin {
-public:
-    perlin() {
-        ranvec = new vec3[point_count];
-        for (int i = 0; i < point_count; ++i) {
-            ranvec[i] = unit_vector(vec3::random(-1,1));
-        }
+#include <map>
+#include <mutex>
+#include <random>
+#include <utility>
 
-        perm_x = perlin_generate_perm();
-        perm_y = perlin_generate_perm();
-        perm_z = perlin_generate_perm();
-    }
+// SSE evaluates the eight lattice corners four at a time, define RTW_NO_SIMD for the scalar path
+#if defined(__SSE__) && !defined(RTW_NO_SIMD)
+#define RTW_PERLIN_SSE
+#include <xmmintrin.h>
+#endif
 
-    ~perlin() {
-        delete[] ranvec;
-        delete[] perm_x;
-        delete[] perm_y;
-        delete[] perm_z;
-    }
+class perlin {
+public:
+    // Noise textures built with the same seed share one read-only table, so this is cheap to construct
+    explicit perlin(unsigned int seed = 0) : table(shared_table(seed)) {}
 
     double noise(const point3& p) const {
         double u = p.x() - floor(p.x());
         double v = p.y() - floor(p.y());
         double w = p.z() - floor(p.z());
 
-        // u = u*u*(3-2*u);
-        // v = v*v*(3-2*v);
-        // w = w*w*(3-2*w);
-        
         int i = static_cast<int>(floor(p.x()));
         int j = static_cast<int>(floor(p.y()));
         int k = static_cast<int>(floor(p.z()));
 
+#ifdef RTW_PERLIN_SSE
+        const lattice_entry* e = table->entries;
+        int x0 = e[i & 255].perm_x, x1 = e[(i+1) & 255].perm_x;
+        int y0 = e[j & 255].perm_y, y1 = e[(j+1) & 255].perm_y;
+        int z0 = e[k & 255].perm_z, z1 = e[(k+1) & 255].perm_z;
+
+        // lanes hold the four (dj,dk) corners: (0,0) (0,1) (1,0) (1,1)
+        __m128 dy = _mm_sub_ps(_mm_set1_ps(float(v)), _mm_setr_ps(0, 0, 1, 1));
+        __m128 dz = _mm_sub_ps(_mm_set1_ps(float(w)), _mm_setr_ps(0, 1, 0, 1));
+
+        float uu = float(u*u*(3-2*u));
+        float vv = float(v*v*(3-2*v));
+        float ww = float(w*w*(3-2*w));
+        __m128 weight_yz = _mm_mul_ps(_mm_setr_ps(1-vv, 1-vv, vv, vv), _mm_setr_ps(1-ww, ww, 1-ww, ww));
+
+        __m128 near_face = corner_dots(x0, y0, y1, z0, z1, _mm_set1_ps(float(u)), dy, dz);
+        __m128 far_face  = corner_dots(x1, y0, y1, z0, z1, _mm_set1_ps(float(u - 1)), dy, dz);
+
+        __m128 accum = _mm_mul_ps(weight_yz, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(1-uu), near_face),
+                                                        _mm_mul_ps(_mm_set1_ps(uu), far_face)));
+
+        // horizontal sum of the four lanes
+        accum = _mm_add_ps(accum, _mm_movehl_ps(accum, accum));
+        accum = _mm_add_ss(accum, _mm_shuffle_ps(accum, accum, 1));
+        return _mm_cvtss_f32(accum);
+#else
+        const lattice_entry* e = table->entries;
         vec3 c[2][2][2];
 
         for (int di = 0; di < 2; di++) {
             for (int dj = 0; dj < 2; dj++) {
                 for (int dk = 0; dk < 2; dk++) {
-                    c[di][dj][dk] = ranvec[
-                            perm_x[(i+di) & 255] ^
-                            perm_y[(j+dj) & 255] ^
-                            perm_z[(k+dk) & 255]
-                        ];
+                    const float* g = e[
+                            e[(i+di) & 255].perm_x ^
+                            e[(j+dj) & 255].perm_y ^
+                            e[(k+dk) & 255].perm_z
+                        ].gradient;
+                    c[di][dj][dk] = vec3(g[0], g[1], g[2]);
                 }
             }
         }
 
         return trilinear_interp(c, u, v, w);
+#endif
     }
 
     double turb(const point3& p, int depth=7) const {
@@ -69,31 +90,80 @@ public:
 
 private:
     static const int point_count = 256;
-    vec3* ranvec;
-    int* perm_x;
-    int* perm_y;
-    int* perm_z;
 
-    static int* perlin_generate_perm() {
-        auto p = new int[point_count];
+    // Entry n holds gradient n next to perm_x[n], perm_y[n] and perm_z[n], so the whole
+    // table is 8 KiB, two entries per cache line, instead of four separately allocated arrays
+    struct alignas(16) lattice_entry {
+        float gradient[4];  // padded so it's one aligned SIMD load
+        int perm_x, perm_y, perm_z, pad;
+    };
 
-        for (int i = 0; i < perlin::point_count; i++) {
-            p[i] = i;
+    struct lattice_table {
+        lattice_entry entries[point_count];
+    };
+
+    shared_ptr<const lattice_table> table;
+
+    // The table for a seed, generated on first use and kept for the rest of the run
+    static shared_ptr<const lattice_table> shared_table(unsigned int seed) {
+        static std::mutex mutex;
+        static std::map<unsigned int, shared_ptr<const lattice_table>> tables;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        auto& t = tables[seed];
+        if (!t) t = generate(seed);
+        return t;
+    }
+
+    static shared_ptr<const lattice_table> generate(unsigned int seed) {
+        // a private generator, so tables only depend on their seed and leave random_double()'s alone
+        std::mt19937 rng(seed);
+        auto uniform = [&rng]() { return rng() / 4294967296.0; };
+
+        auto t = make_shared<lattice_table>();
+        for (int n = 0; n < point_count; n++) {
+            vec3 g;
+            do {
+                g = vec3(2*uniform() - 1, 2*uniform() - 1, 2*uniform() - 1);
+            } while (g.length_squared() < 1e-6);
+            g = unit_vector(g);
+
+            lattice_entry& e = t->entries[n];
+            e.gradient[0] = float(g.x());
+            e.gradient[1] = float(g.y());
+            e.gradient[2] = float(g.z());
+            e.gradient[3] = 0.0f;
+            e.perm_x = e.perm_y = e.perm_z = n;
+            e.pad = 0;
         }
 
-        permute(p, point_count);
-        return p;
+        permute(t->entries, &lattice_entry::perm_x, rng);
+        permute(t->entries, &lattice_entry::perm_y, rng);
+        permute(t->entries, &lattice_entry::perm_z, rng);
+        return t;
     }
 
-    static void permute(int* p, int n) {
-        for (int i = n-1; i > 0; i--) {
-            int target = random_int(0, i);
-            int tmp = p[i];
-            p[i] = p[target];
-            p[target] = tmp;
+    static void permute(lattice_entry* entries, int lattice_entry::* perm, std::mt19937& rng) {
+        for (int i = point_count-1; i > 0; i--) {
+            int target = static_cast<int>(rng() % (i + 1));
+            std::swap(entries[i].*perm, entries[target].*perm);
         }
     }
 
+#ifdef RTW_PERLIN_SSE
+    // dot products of the gradients at the four corners of the face at x permutation px with their offsets to p
+    __m128 corner_dots(int px, int y0, int y1, int z0, int z1, __m128 dx, __m128 dy, __m128 dz) const {
+        const lattice_entry* e = table->entries;
+        __m128 gx = _mm_load_ps(e[px ^ y0 ^ z0].gradient);
+        __m128 gy = _mm_load_ps(e[px ^ y0 ^ z1].gradient);
+        __m128 gz = _mm_load_ps(e[px ^ y1 ^ z0].gradient);
+        __m128 gw = _mm_load_ps(e[px ^ y1 ^ z1].gradient);
+        _MM_TRANSPOSE4_PS(gx, gy, gz, gw);  // now one component of all four gradients per register
+
+        return _mm_add_ps(_mm_add_ps(_mm_mul_ps(gx, dx), _mm_mul_ps(gy, dy)), _mm_mul_ps(gz, dz));
+    }
+#endif
+
     static double trilinear_interp(double c[2][2][2], double u, double v, double w) {
         double accum = 0.0;
         for (int i=0; i<2; i++) {
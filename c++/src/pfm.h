@@ -0,0 +1,73 @@
+#ifndef PFM_H
+#define PFM_H
+
+// Portable Float Map (.pfm) reading and writing, for HDR images stb doesn't handle
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Reads an RGB ("PF") or greyscale ("Pf") float map into top-to-bottom rows of RGB floats
+inline bool read_pfm(const std::string& filename, std::vector<float>& rgb, int& width, int& height) {
+    std::FILE* f = std::fopen(filename.c_str(), "rb");
+    if (!f) return false;
+
+    char magic[3] = {0};
+    double scale = 0;
+    if (std::fscanf(f, "%2s %d %d %lf", magic, &width, &height, &scale) != 4 || std::fgetc(f) == EOF
+        || (std::strcmp(magic, "PF") != 0 && std::strcmp(magic, "Pf") != 0) || width <= 0 || height <= 0) {
+        std::fclose(f);
+        return false;
+    }
+
+    int channels = (magic[1] == 'F') ? 3 : 1;
+    std::vector<float> raw(static_cast<size_t>(width) * height * channels);
+    bool ok = std::fread(raw.data(), sizeof(float), raw.size(), f) == raw.size();
+    std::fclose(f);
+    if (!ok) return false;
+
+    // negative scale := little endian
+    unsigned int probe = 1;
+    bool host_little = *reinterpret_cast<unsigned char*>(&probe) == 1;
+    if ((scale < 0) != host_little) {
+        for (float& x : raw) {
+            unsigned char* b = reinterpret_cast<unsigned char*>(&x);
+            std::swap(b[0], b[3]);
+            std::swap(b[1], b[2]);
+        }
+    }
+
+    // rows are stored bottom to top
+    rgb.resize(static_cast<size_t>(width) * height * 3);
+    for (int y = 0; y < height; y++) {
+        const float* src = &raw[static_cast<size_t>(height - 1 - y) * width * channels];
+        float* dst = &rgb[static_cast<size_t>(y) * width * 3];
+        for (int x = 0; x < width; x++) {
+            for (int c = 0; c < 3; c++) {
+                dst[3*x + c] = src[channels*x + (channels == 3 ? c : 0)];
+            }
+        }
+    }
+    return true;
+}
+
+// Writes top-to-bottom rows of `channels` (1 or 3) floats per pixel
+inline bool write_pfm(const std::string& filename, const float* data, int width, int height, int channels = 3) {
+    std::FILE* f = std::fopen(filename.c_str(), "wb");
+    if (!f) return false;
+
+    unsigned int probe = 1;
+    bool host_little = *reinterpret_cast<unsigned char*>(&probe) == 1;
+    std::fprintf(f, "%s\n%d %d\n%s\n", channels == 3 ? "PF" : "Pf", width, height, host_little ? "-1.0" : "1.0");
+
+    bool ok = true;
+    for (int y = height - 1; y >= 0 && ok; y--) {
+        size_t row = static_cast<size_t>(width) * channels;
+        ok = std::fwrite(data + y*row, sizeof(float), row, f) == row;
+    }
+
+    return (std::fclose(f) == 0) && ok;
+}
+
+#endif
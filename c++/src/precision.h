@@ -0,0 +1,30 @@
+#ifndef PRECISION_H
+#define PRECISION_H
+
+#include <cmath>
+#include <limits>
+
+// Scalar type of the geometry core: vec3 (and so colours), interval, aabb, ray, hit records and the
+// primitives' own data.  float by default, which halves the memory traffic and doubles the SIMD width
+// of double; build with -DRTW_USE_DOUBLE to go back to double throughout.
+#ifdef RTW_USE_DOUBLE
+typedef double real;
+#else
+typedef float real;
+#endif
+
+// The <cmath> overloads, so float arguments stay float instead of going through the C library's double versions
+using std::fabs;
+using std::fmin;
+using std::fmax;
+using std::sqrt;
+using std::floor;
+
+// Hit points are off the true surface by a few ulps of their largest coordinate, so a ray leaving a
+// surface must ignore hits closer than a distance relative to its origin's magnitude, here a few
+// hundred ulps of `real`, which is large enough for every primitive here and too small to see
+inline real self_intersection_distance(real max_coordinate) {
+    return 256 * std::numeric_limits<real>::epsilon() * (1 + max_coordinate);
+}
+
+#endif
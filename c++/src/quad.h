@@ -3,7 +3,8 @@
 
 #include "rtweekend.h"
 #include "hittable.h"
-#include "hittable_list.h"
+#include "material.h"
+#include "stats.h"
 
 #include <cmath>
 
@@ -17,6 +18,8 @@ public:
         D = dot(normal, Q);
         w = n / dot(n,n); // \hat{n} / n
 
+        area = n.length();
+
         set_bounding_box();
     }
 
@@ -27,33 +30,35 @@ public:
     aabb bounding_box() const override { return bbox; }
 
     bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
-        double denom = dot(normal, r.direction());
+        RTW_STAT(primitive_tests[stat_quad]);
+        real denom = dot(normal, r.direction());
 
         // No hit if the ray is parallel to the plane
         if (fabs(denom) < 1e-8) return false;
 
         // No hit if the hit point parameter, t, is outside the ray interval
-        double t = (D - dot(normal, r.origin())) / denom;
+        real t = (D - dot(normal, r.origin())) / denom;
         if (!ray_t.contains(t)) return false;
 
         // Determine the hit point lies within the planar shape using its plane coordinates
         point3 intersection = r.at(t);
         vec3 planar_hitpt_vector = intersection - Q;
-        double alpha = dot(w, cross(planar_hitpt_vector, v));
-        double beta = dot(w, cross(u, planar_hitpt_vector));
+        real alpha = dot(w, cross(planar_hitpt_vector, v));
+        real beta = dot(w, cross(u, planar_hitpt_vector));
 
         if (!is_interior(alpha, beta, rec)) return false;
         // Ray hits shape 
 
         rec.t = t;
         rec.p = intersection;
+        rec.uv_width = r.spread() * t * r.direction().length() / sqrt(area);
         rec.mat = mat;
         rec.set_face_normal(r, normal);
         
         return true;
     }
 
-    virtual bool is_interior(double a, double b, hit_record& rec) const {
+    virtual bool is_interior(real a, real b, hit_record& rec) const {
         // Given the hit point in plane coords, return false if it is outide 
         // the primitive, otherwise set the hit record UV coords and return true
 
@@ -64,37 +69,42 @@ public:
         return true;
     }
 
+    double pdf_value(const point3& origin, const vec3& direction) const override {
+        hit_record rec;
+        ray r(origin, direction);
+        if (!this->hit(r, interval(r.min_t(), infinity), rec)) return 0;
+
+        double distance_squared = rec.t * rec.t * direction.length_squared();
+        double cosine = fabs(dot(direction, rec.normal) / direction.length());
+
+        return distance_squared / (cosine * area);
+    }
+
+    vec3 random(const point3& origin) const override {
+        point3 p = Q + (random_double() * u) + (random_double() * v);
+        return p - origin;
+    }
+
+    light_bounds emission_bounds() const override {
+        // diffuse_light emits from both faces
+        light_bounds lb;
+        lb.bounds = bbox;
+        lb.phi = 2 * pi * area * luminance(mat->emitted(0.5, 0.5, Q + 0.5*(u+v)));
+        lb.w = normal;
+        lb.cos_theta_o = 1;
+        lb.two_sided = true;
+        return lb;
+    }
+
 private:
     point3 Q;  // origin of the quad/parallelogram
     vec3 u, v; // the two sides originating from Q (The parallelogram has 4 vertices: Q, Q+u, Q+v, Q+u+v) (Q and Q+u+v are oposite corners)
     shared_ptr<material> mat;
     aabb bbox;
     vec3 normal;
-    double D;
+    real D;
     vec3 w;
+    real area;
 };
 
-inline shared_ptr<hittable_list> box(const point3& a, const point3& b, shared_ptr<material> mat) {
-    // Returns the 3D box (six sides) that contain the two opposite vertices a & b 
-
-    auto sides = make_shared<hittable_list>();
-
-    // Two opposite vertices with the minimum and maximum coords
-    auto min = point3(fmin(a.x(), b.x()), fmin(a.y(), b.y()), fmin(a.z(), b.z()));
-    auto max = point3(fmax(a.x(), b.x()), fmax(a.y(), b.y()), fmax(a.z(), b.z()));
-
-    auto dx = vec3(max.x() - min.x(), 0, 0);
-    auto dy = vec3(0, max.y() - min.y(), 0);
-    auto dz = vec3(0, 0, max.z() - min.z());
-
-    sides->add(make_shared<quad>(point3(min.x(), min.y(), max.z()), dx, dy, mat));  // front
-    sides->add(make_shared<quad>(point3(max.x(), min.y(), max.z()), -dz, dy, mat));  // right
-    sides->add(make_shared<quad>(point3(max.x(), min.y(), min.z()), -dx, dy, mat));  // back
-    sides->add(make_shared<quad>(point3(min.x(), min.y(), min.z()), dz, dy, mat));  // left
-    sides->add(make_shared<quad>(point3(min.x(), max.y(), max.z()), dx, -dz, mat));  // top
-    sides->add(make_shared<quad>(point3(min.x(), min.y(), min.z()), dx, dz, mat));  // bottom
-
-    return sides;
-}
-
 #endif // QUAD_H
\ No newline at end of file
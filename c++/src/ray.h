@@ -7,20 +7,39 @@ class ray {
 public:
     ray() {}
     // ray(const point3 &origin, const vec3& direction) : orig(origin), dir(direction), tm(0) {}  // Why do we need this constructor??
-    ray(const point3 &origin, const vec3& direction, double time = 0.0) : orig(origin), dir(direction), tm(time) {}
+    ray(const point3 &origin, const vec3& direction, real time = 0.0, real spread = 0.0) : orig(origin), dir(direction), tm(time), spr(spread) {
+        // once per ray rather than at every bounding box the ray is tested against
+        for (int a = 0; a < 3; a++) {
+            inv_dir[a] = 1 / dir[a];  // +-infinity for a zero component
+            neg[a] = inv_dir[a] < 0;
+        }
+    }
+
+    const point3& origin() const { return orig; }
+    const vec3& direction() const { return dir; }
+    real time() const { return tm; }
+    real spread() const { return spr; }  // Angle (radians) the ray's cone widens by, for texture filtering. 0 := a thin ray
 
-    point3 origin() const { return orig; }
-    vec3 direction() const { return dir; }
-    double time() const { return tm; }
+    const vec3& inv_direction() const { return inv_dir; }
+    int sign(int axis) const { return neg[axis]; }  // 1 if the direction is negative along axis, else 0
 
-    point3 at(const double t) const {
+    point3 at(const real t) const {
         return orig + t*dir;
     }
+
+    // Smallest t to accept hits at, so a ray leaving a surface doesn't hit that surface again
+    real min_t() const {
+        real max_coordinate = fmax(fabs(orig.x()), fmax(fabs(orig.y()), fabs(orig.z())));
+        return self_intersection_distance(max_coordinate) / dir.length();
+    }
     
 private:
     point3 orig;
     vec3 dir;
-    double tm;
+    real tm;
+    real spr;
+    vec3 inv_dir;
+    int neg[3];
 };
 
 #endif
\ No newline at end of file
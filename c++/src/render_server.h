@@ -0,0 +1,407 @@
+#ifndef RENDER_SERVER_H
+#define RENDER_SERVER_H
+
+// Long running renderer taking jobs one per line, on stdin or from clients of a unix socket:
+//
+//   render scene=<scene file or built-in scene> out=<file.ppm> [width=N] [aspect=R] [spp=N] [depth=N]
+//          [vfov=D] [lookfrom=x,y,z] [lookat=x,y,z] [priority=N] [seed=N] [id=NAME]
+//   quit
+//
+// Settings left out keep the scene's own.  Each job is answered with "queued <id>" straight away and
+// "done <id> <seconds> <file>" or "error <id> <why>" once it finishes, so answers to a client's jobs
+// come in the order they finish.  Jobs run concurrently on the server's threads, highest priority
+// first (a running job isn't preempted), and each one renders on a single thread.  Jobs don't
+// checkpoint, a scene file's checkpoint setting is ignored.  A job's samples come from its thread's
+// generator seeded with seed= (1 when left out), so the same job gives the same image whatever else
+// is running.
+//
+// Scenes stay loaded between jobs with their BVHs, as do the images their textures decoded, so only
+// the first job for a scene pays for it.  A scene file is loaded again when its modification time or
+// size changes.  On stdin the server stops at quit or the end of input, on a socket when any client
+// sends quit, and in both cases after finishing the jobs already queued.
+//
+//   ../out/main --serve [--socket PATH] [--threads N]   (from c++/src)
+//   echo "render scene=cornell_box out=box.ppm spp=16" | nc -U PATH
+
+#include "rtweekend.h"
+#include "scene.h"
+#include "scene_loader.h"
+#include "scenes.h"
+#include "thread_pool.h"
+
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Loaded scenes by file name or built-in scene name
+class scene_store {
+public:
+    // The scene, loaded the first time it's asked for and again after its file changes, or null
+    shared_ptr<const scene> get(const std::string& name, std::string& error) {
+        std::string stamp;
+        bool builtin = false;
+        for (const named_scene& b : builtin_scenes()) builtin = builtin || name == b.name;
+
+        struct stat st;
+        if (!builtin) {
+            if (stat(name.c_str(), &st) != 0) {
+                error = "no scene file or built-in scene '" + name + "'";
+                return nullptr;
+            }
+            stamp = std::to_string(st.st_mtim.tv_sec) + '.' + std::to_string(st.st_mtim.tv_nsec) + '/' + std::to_string(st.st_size);
+        }
+
+        std::shared_future<shared_ptr<const scene>> pending;
+        std::promise<shared_ptr<const scene>> loaded;
+        bool load_here = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = scenes.find(name);
+            if (it != scenes.end() && it->second.stamp == stamp) {
+                pending = it->second.loaded;
+            } else {
+                // jobs for the same scene wait for this load rather than loading it again
+                pending = loaded.get_future().share();
+                scenes[name] = entry{stamp, pending};
+                load_here = true;
+            }
+        }
+
+        if (load_here) loaded.set_value(load(name, builtin));
+
+        shared_ptr<const scene> s = pending.get();
+        if (!s) error = "could not load the scene '" + name + "'";
+        return s;
+    }
+
+private:
+    struct entry {
+        std::string stamp;  // modification time and size of the file it was loaded from
+        std::shared_future<shared_ptr<const scene>> loaded;
+    };
+
+    std::mutex mutex;
+    std::unordered_map<std::string, entry> scenes;
+
+    static shared_ptr<const scene> load(const std::string& name, bool builtin) {
+        // the same random geometry (and BVH) however many jobs ran on the loading thread before,
+        // and as ../out/main builds from its first random numbers
+        seed_random(1);
+        if (!builtin) return load_scene(name);
+        for (const named_scene& b : builtin_scenes()) {
+            if (name != b.name) continue;
+            auto built = make_shared<scene>(b.build());
+            std::string source = "built-in " + name;
+            built->cam.scene_hash = fnv1a(source.data(), source.size());
+            return built;
+        }
+        return nullptr;
+    }
+};
+
+class render_server {
+public:
+    explicit render_server(int threads) : pool(threads) {}
+
+    // Answers the jobs on stdin on stdout, until quit or the end of input
+    void serve_stdio() {
+        auto client = make_shared<connection>(0, 1, false);
+        std::string pending, line;
+        while (read_line(0, pending, line)) {
+            if (!handle(line, client)) break;
+        }
+    }
+
+    // Answers jobs from every client of a unix socket at path, until one of them sends quit
+    bool serve_socket(const std::string& path) {
+        sockaddr_un address;
+        std::memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(address.sun_path)) {
+            std::cerr << "ERROR: The socket path '" << path << "' is too long.\n";
+            return false;
+        }
+        std::strcpy(address.sun_path, path.c_str());
+
+        struct stat st;
+        if (stat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) unlink(path.c_str());  // left by an earlier server
+
+        listener = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listener < 0 || bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listener, 16) != 0) {
+            std::cerr << "ERROR: Could not listen on '" << path << "': " << std::strerror(errno) << ".\n";
+            if (listener >= 0) close(listener);
+            return false;
+        }
+
+        std::vector<reader> readers;
+        while (true) {
+            int fd = accept(listener, nullptr, nullptr);
+            if (fd < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) continue;
+                break;  // shut down by quit
+            }
+
+            // forget the clients that have gone since the last one came, so a long running server
+            // only holds on to the connected ones
+            for (size_t r = 0; r < readers.size(); ) {
+                if (!*readers[r].done) {
+                    r++;
+                    continue;
+                }
+                readers[r].thread.join();
+                readers.erase(readers.begin() + r);
+            }
+
+            std::lock_guard<std::mutex> lock(clients_mutex);
+            clients.erase(std::remove_if(clients.begin(), clients.end(),
+                                         [](const std::weak_ptr<connection>& c) { return c.expired(); }),
+                          clients.end());
+            if (stopping) {
+                close(fd);
+                break;
+            }
+            auto client = make_shared<connection>(fd, fd, true);
+            clients.push_back(client);
+
+            auto done = make_shared<std::atomic<bool>>(false);
+            readers.push_back(reader{std::thread([this, client, done]() {
+                std::string pending, line;
+                while (read_line(client->in, pending, line)) {
+                    if (!handle(line, client)) {
+                        stop();
+                        break;
+                    }
+                }
+                *done = true;
+            }), done});
+        }
+
+        for (auto& r : readers) r.thread.join();
+        close(listener);
+        unlink(path.c_str());
+        return true;
+    }
+
+private:
+    // One end of the conversation, replies from any thread are written whole
+    struct connection {
+        int in, out;
+        bool socket;
+        std::mutex mutex;
+
+        connection(int in, int out, bool socket) : in(in), out(out), socket(socket) {}
+        ~connection() { if (socket) close(in); }
+
+        void reply(const std::string& text) {
+            std::string line = text + '\n';
+            std::lock_guard<std::mutex> lock(mutex);
+            for (size_t sent = 0; sent < line.size(); ) {
+                ssize_t n = socket ? send(out, line.data() + sent, line.size() - sent, MSG_NOSIGNAL)
+                                   : write(out, line.data() + sent, line.size() - sent);
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) return;  // the client has gone
+                sent += static_cast<size_t>(n);
+            }
+        }
+    };
+
+    // A thread reading a socket client's jobs, done once the client has gone or sent quit
+    struct reader {
+        std::thread thread;
+        shared_ptr<std::atomic<bool>> done;
+    };
+
+    struct render_job {
+        std::string id, scene, output;
+        int width = 0, spp = 0, depth = 0, priority = 0;  // 0 keeps the scene's own setting
+        int seed = 1;  // of the job's samples, so its image doesn't depend on what else is running
+        double aspect = 0, vfov = 0;
+        bool has_lookfrom = false, has_lookat = false;
+        point3 lookfrom, lookat;
+    };
+
+    scene_store scenes;
+    std::atomic<unsigned long long> jobs{0};
+    int listener = -1;
+    std::mutex clients_mutex;
+    std::vector<std::weak_ptr<connection>> clients;
+    bool stopping = false;
+    thread_pool pool;  // last, so it finishes the queued jobs before anything they use goes away
+
+    // Returns false for quit
+    bool handle(const std::string& line, const shared_ptr<connection>& client) {
+        std::istringstream words(line);
+        std::string command;
+        if (!(words >> command)) return true;
+        if (command == "quit") return false;
+
+        render_job job;
+        std::string error;
+        if (command != "render") {
+            error = "unknown command '" + command + "'";
+        } else {
+            parse_job(words, job, error);
+        }
+        if (job.id.empty()) job.id = std::to_string(++jobs);
+        if (!error.empty()) {
+            client->reply("error " + job.id + ' ' + error);
+            return true;
+        }
+
+        client->reply("queued " + job.id);
+        pool.submit([this, job, client]() { run(job, *client); }, job.priority);
+        return true;
+    }
+
+    void run(const render_job& job, connection& client) {
+        auto start = std::chrono::steady_clock::now();
+
+        std::string error;
+        shared_ptr<const scene> s = scenes.get(job.scene, error);
+        if (!s) {
+            client.reply("error " + job.id + ' ' + error);
+            return;
+        }
+
+        camera cam = s->cam;
+        cam.write_image = false;
+        cam.checkpoint.clear();  // jobs run side by side, they'd all share the scene's file
+        cam.report_stats = false;  // and the process's counters
+        if (job.width) cam.image_width = job.width;
+        if (job.aspect) cam.aspect_ratio = job.aspect;
+        if (job.spp) cam.samples_per_pixel = job.spp;
+        if (job.depth) cam.max_depth = job.depth;
+        if (job.vfov) cam.vfov = job.vfov;
+        if (job.has_lookfrom) cam.lookfrom = job.lookfrom;
+        if (job.has_lookat) cam.lookat = job.lookat;
+
+        seed_random(static_cast<unsigned int>(job.seed));  // this thread's generator, see rtweekend.h
+        if (s->lights) cam.render(s->world, *s->lights);
+        else cam.render(s->world);
+
+        std::ofstream out(job.output);
+        cam.write_ppm(out);
+        out.close();
+        if (!out) {
+            client.reply("error " + job.id + " could not write '" + job.output + "'");
+            return;
+        }
+
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        client.reply("done " + job.id + ' ' + std::to_string(elapsed.count()) + ' ' + job.output);
+    }
+
+    // Stops accepting clients and reading from the ones connected, their queued jobs still finish
+    void stop() {
+        std::lock_guard<std::mutex> lock(clients_mutex);
+        if (stopping) return;
+        stopping = true;
+        shutdown(listener, SHUT_RDWR);
+        for (auto& c : clients) {
+            if (auto client = c.lock()) shutdown(client->in, SHUT_RD);
+        }
+    }
+
+    static bool parse_job(std::istringstream& words, render_job& job, std::string& error) {
+        std::string word;
+        while (words >> word) {
+            size_t equals = word.find('=');
+            if (equals == std::string::npos) return fail(error, "expected key=value, not '" + word + "'");
+            std::string key = word.substr(0, equals), value = word.substr(equals + 1);
+
+            bool ok = true;
+            if (key == "id") job.id = value;
+            else if (key == "scene") job.scene = value;
+            else if (key == "out") job.output = value;
+            else if (key == "width") ok = parse_int(value, job.width) && job.width > 0;
+            else if (key == "spp") ok = parse_int(value, job.spp) && job.spp > 0;
+            else if (key == "depth") ok = parse_int(value, job.depth) && job.depth > 0;
+            else if (key == "priority") ok = parse_int(value, job.priority);
+            else if (key == "seed") ok = parse_int(value, job.seed);
+            else if (key == "aspect") ok = parse_double(value, job.aspect) && job.aspect > 0;
+            else if (key == "vfov") ok = parse_double(value, job.vfov) && job.vfov > 0 && job.vfov < 180;
+            else if (key == "lookfrom") ok = job.has_lookfrom = parse_point(value, job.lookfrom);
+            else if (key == "lookat") ok = job.has_lookat = parse_point(value, job.lookat);
+            else return fail(error, "unknown setting '" + key + "'");
+
+            if (!ok) return fail(error, "bad value for " + key + ": '" + value + "'");
+        }
+
+        if (job.scene.empty()) return fail(error, "no scene=");
+        if (job.output.empty()) return fail(error, "no out=");
+        return true;
+    }
+
+    static bool fail(std::string& error, const std::string& why) {
+        error = why;
+        return false;
+    }
+
+    static bool parse_double(const std::string& s, double& x) {
+        char* end;
+        x = std::strtod(s.c_str(), &end);
+        return !s.empty() && *end == '\0';
+    }
+
+    static bool parse_int(const std::string& s, int& x) {
+        char* end;
+        long v = std::strtol(s.c_str(), &end, 10);
+        x = static_cast<int>(v);
+        return !s.empty() && *end == '\0' && v == x;
+    }
+
+    static bool parse_point(const std::string& s, point3& p) {
+        std::istringstream parts(s);
+        std::string part;
+        double xyz[3];
+        for (int i = 0; i < 3; i++) {
+            if (!std::getline(parts, part, ',') || !parse_double(part, xyz[i])) return false;
+        }
+        if (std::getline(parts, part, ',')) return false;
+        p = point3(xyz[0], xyz[1], xyz[2]);
+        return true;
+    }
+
+    // The next line from fd, with what's been read past it kept in pending
+    static bool read_line(int fd, std::string& pending, std::string& line) {
+        while (true) {
+            size_t newline = pending.find('\n');
+            if (newline != std::string::npos) {
+                line = pending.substr(0, newline);
+                pending.erase(0, newline + 1);
+                if (!line.empty() && line.back() == '\r') line.pop_back();
+                return true;
+            }
+
+            char buffer[4096];
+            ssize_t n = read(fd, buffer, sizeof(buffer));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {  // the end of input, with maybe a last line without a newline
+                if (pending.empty()) return false;
+                line.swap(pending);
+                pending.clear();
+                return true;
+            }
+            pending.append(buffer, static_cast<size_t>(n));
+        }
+    }
+};
+
+#endif
@@ -12,27 +12,40 @@
 #define STBI_FAILURE_USERMSG
 
 #include "external/stb_image.h"
+#include "pfm.h"
+#include "trace.h"
 
 #include <cstdlib>
 #include <iostream>
+#include <string>
+#include <vector>
+
+// Tries `load` on image_filename in $RTM_IMAGES, the working directory and the images/
+// directories above it, returning true as soon as one of them succeeds
+template <typename F>
+bool rtw_search_image(const char* image_filename, F load) {
+    std::string filename = std::string(image_filename);
+    auto imagedir = getenv("RTM_IMAGES");
+
+    if (imagedir && load(std::string(imagedir) + "/" + image_filename)) return true;
+    if (load(filename)) return true;
+    if (load("images/" + filename)) return true;
+    if (load("../images/" + filename)) return true;
+    if (load("../../images/" + filename)) return true;
+    if (load("../../../images/" + filename)) return true;
+    if (load("../../../../images/" + filename)) return true;
+    if (load("../../../../../images/" + filename)) return true;
+    if (load("../../../../../../images/" + filename)) return true;
+
+    return false;
+}
 
 class rtw_image {
 public:
     rtw_image() : data(nullptr) {}
 
-    rtw_image(const char* image_filename) {
-        std::string filename = std::string(image_filename);
-        auto imagedir = getenv("RTM_IMAGES");
-
-        if (imagedir && load(std::string(imagedir) + "/" + image_filename)) return;
-        if (load(filename)) return;
-        if (load("images/" + filename)) return;
-        if (load("../images/" + filename)) return;
-        if (load("../../images/" + filename)) return;
-        if (load("../../../images/" + filename)) return;
-        if (load("../../../../images/" + filename)) return;
-        if (load("../../../../../images/" + filename)) return;
-        if (load("../../../../../../images/" + filename)) return;
+    rtw_image(const char* image_filename) : data(nullptr) {
+        if (rtw_search_image(image_filename, [this](const std::string& f) { return load(f); })) return;
 
         std::cerr << "ERROR: Could not load image file '" << image_filename << "'.\n";
     }
@@ -40,6 +53,7 @@ public:
     ~rtw_image() { STBI_FREE(data); }
 
     bool load(const std::string filename) {
+        trace::span span("rtw_image load", filename);
         int n = bytes_per_pixel;
         data = stbi_load(filename.c_str(), &image_width, &image_height, &n, bytes_per_pixel);
         bytes_per_scanline = image_width * bytes_per_pixel;
@@ -73,6 +87,51 @@ private:
     }
 };
 
+// Linear floating point RGB image: Radiance .hdr (and LDR formats, linearized) through
+// stb, or .pfm
+class rtw_float_image {
+public:
+    rtw_float_image() : image_width(0), image_height(0) {}
+
+    rtw_float_image(const char* image_filename) : image_width(0), image_height(0) {
+        if (rtw_search_image(image_filename, [this](const std::string& f) { return load(f); })) return;
+
+        std::cerr << "ERROR: Could not load image file '" << image_filename << "'.\n";
+    }
+
+    bool load(const std::string& filename) {
+        trace::span span("rtw_float_image load", filename);
+        if (filename.size() > 4 && filename.compare(filename.size() - 4, 4, ".pfm") == 0) {
+            return read_pfm(filename, data, image_width, image_height);
+        }
+
+        int n = 3;
+        float* fdata = stbi_loadf(filename.c_str(), &image_width, &image_height, &n, 3);
+        if (fdata == nullptr) return false;
+
+        data.assign(fdata, fdata + static_cast<size_t>(image_width) * image_height * 3);
+        STBI_FREE(fdata);
+        return true;
+    }
+
+    int width() const { return data.empty() ? 0 : image_width; }
+    int height() const { return data.empty() ? 0 : image_height; }
+
+    const float* pixel_data(int x, int y) const {
+        static const float magenta[] = { 1, 0, 1 };
+        if (data.empty()) return magenta;
+
+        x = (x < 0) ? 0 : (x >= image_width ? image_width-1 : x);
+        y = (y < 0) ? 0 : (y >= image_height ? image_height-1 : y);
+
+        return &data[(static_cast<size_t>(y)*image_width + x) * 3];
+    }
+
+private:
+    std::vector<float> data;
+    int image_width, image_height;
+};
+
 // restore MSVC compiler warnings
 #ifdef _MSC_VER
     #pragma warning (pop)
@@ -2,9 +2,14 @@
 #define RTWEEKEND_H
 
 #include <cmath>
+#include <cstddef>
+#include <cstdint>
 #include <cstdlib>
 #include <limits>
 #include <memory>
+#include <random>
+
+#include "precision.h"
 
 // usings
 using std::shared_ptr;
@@ -20,8 +25,19 @@ inline double degree_to_radians(double deg) {
     return deg * pi / 180.0;
 }
 
+// Each thread draws from its own generator, so threads rendering at the same time don't share a
+// lock or each other's sequences.  A thread starts from seed 1, as rand() did
+inline std::mt19937& random_generator() {
+    static thread_local std::mt19937 generator(1);
+    return generator;
+}
+
+inline void seed_random(unsigned int seed) {
+    random_generator().seed(seed);
+}
+
 inline double random_double() {
-    return rand() / (RAND_MAX + 1.0);  // Random real \in [0,1)
+    return random_generator()() / 4294967296.0;  // Random real \in [0,1)
 }
 
 inline double random_double(double min, double max) {
@@ -32,6 +48,13 @@ inline int random_int(int min, double max) {
     return static_cast<int>(random_double(min, max+1));
 }
 
+// FNV-1a over the bytes, continuing from hash to cover several pieces
+inline uint64_t fnv1a(const void* data, size_t bytes, uint64_t hash = 14695981039346656037ull) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < bytes; i++) hash = (hash ^ p[i]) * 1099511628211ull;
+    return hash;
+}
+
 // common headers
 #include "interval.h"
 #include "ray.h"
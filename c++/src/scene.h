@@ -0,0 +1,23 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include "rtweekend.h"
+#include "camera.h"
+#include "hittable_list.h"
+
+// A world, the lights next event estimation samples (none when null) and the camera to render it with
+struct scene {
+    hittable_list world;
+    shared_ptr<hittable> lights;
+    camera cam;
+
+    scene(const hittable_list& world, const camera& cam, shared_ptr<hittable> lights = nullptr)
+        : world(world), lights(lights), cam(cam) {}
+
+    void render() {
+        if (lights) cam.render(world, *lights);
+        else cam.render(world);
+    }
+};
+
+#endif
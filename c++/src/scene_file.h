@@ -0,0 +1,550 @@
+#ifndef SCENE_FILE_H
+#define SCENE_FILE_H
+
+// Scene description files, as text or as a compact binary equivalent.
+//
+// A scene is a sequence of statements, each a kind, an optional quoted name and a block of
+// `key: value` properties and nested statements:
+//
+//     camera { image_width: 400, lookfrom: [278, 278, -800], background: [0, 0, 0] }
+//     material "white" { type: "lambertian", albedo: [.73, .73, .73] }
+//     bvh {
+//         box { a: [0, 0, 0], b: [165, 330, 165], material: "white", rotate_y: 15 }
+//         sphere { center: [190, 90, 190], radius: 90, material: "white" }
+//     }
+//
+// Values are numbers, [x, y, z] vectors (up to three numbers), "strings" and true/false.  Commas are
+// optional and // or # start a comment.  What the statements mean is up to the scene_events receiver
+// (scene_loader.h builds a scene from them), this file only reads and writes the two encodings.
+//
+// The binary form (".rtwb") is the magic "RTWSCENE", a u32 version and then records of a u8 tag,
+// a u32 payload length and the payload: begin (kind and name strings), property (key string, a
+// u8 value type and the value) and end.  Strings are a u16 length and the bytes, numbers are f64,
+// all little endian.  Unknown record tags are skipped using their length, as are bytes past what a
+// known record's payload holds, and no payload is read past its length.
+//
+// Both parsers stream: they read through a fixed size buffer and pass each statement on as it's
+// read, so memory doesn't grow with the file, only with what the receiver keeps.
+
+#include "rtweekend.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+struct scene_value {
+    enum value_type { number, string, boolean };
+
+    value_type type = number;
+    int count = 0;             // how many numbers, 1 for a scalar and 3 for a vector
+    double numbers[3] = {0, 0, 0};
+    std::string text;
+    bool flag = false;
+
+    vec3 as_vec3() const { return vec3(numbers[0], numbers[1], numbers[2]); }
+};
+
+// What a parser produces: the statements in order, nested ones between their parent's begin and end.
+// Returning false stops the parse, with error() saying why
+class scene_events {
+public:
+    virtual ~scene_events() = default;
+
+    virtual bool begin(const std::string& kind, const std::string& name) = 0;
+    virtual bool property(const std::string& key, const scene_value& value) = 0;
+    virtual bool end() = 0;
+    virtual std::string error() const { return ""; }
+};
+
+// Buffered reading of a file for the parsers
+class scene_input {
+public:
+    explicit scene_input(std::FILE* file) : file(file), buffer(1 << 16) {}
+
+    // The next byte, or EOF
+    int peek() {
+        if (pos == size && !fill()) return EOF;
+        return static_cast<unsigned char>(buffer[pos]);
+    }
+
+    int get() {
+        int c = peek();
+        if (c != EOF) pos++;
+        if (c == '\n') line++;
+        return c;
+    }
+
+    bool read(void* out, size_t n) {
+        char* dst = static_cast<char*>(out);
+        while (n > 0) {
+            if (pos == size && !fill()) return false;
+            size_t chunk = std::min(n, size - pos);
+            std::memcpy(dst, &buffer[pos], chunk);
+            pos += chunk;
+            dst += chunk;
+            n -= chunk;
+        }
+        return true;
+    }
+
+    // Passes over n bytes a buffer at a time
+    bool skip(size_t n) {
+        while (n > 0) {
+            if (pos == size && !fill()) return false;
+            size_t chunk = std::min(n, size - pos);
+            pos += chunk;
+            n -= chunk;
+        }
+        return true;
+    }
+
+    int line = 1;
+
+private:
+    std::FILE* file;
+    std::vector<char> buffer;
+    size_t pos = 0, size = 0;
+
+    bool fill() {
+        size = std::fread(buffer.data(), 1, buffer.size(), file);
+        pos = 0;
+        return size > 0;
+    }
+};
+
+class scene_text_parser {
+public:
+    scene_text_parser(std::FILE* file, scene_events& events) : in(file), events(events) {}
+
+    bool parse() {
+        int depth = 0;
+        std::string token, name;
+
+        while (true) {
+            token_type t = next(token);
+            if (t == end_of_file) break;
+            if (t == error_token) return false;
+
+            if (t == close_brace) {
+                if (depth == 0) return fail("unmatched '}'");
+                depth--;
+                if (!events.end()) return fail(events.error());
+                continue;
+            }
+            if (t != identifier) return fail("expected a statement or property, found '" + token + "'");
+
+            std::string word = token;
+            t = next(token);
+
+            if (t == colon) {
+                if (depth == 0) return fail("property '" + word + "' outside a statement");
+                scene_value value;
+                if (!read_value(value)) return false;
+                if (!events.property(word, value)) return fail(events.error());
+                continue;
+            }
+
+            name.clear();
+            if (t == string_token) {
+                name = token;
+                t = next(token);
+            }
+            if (t != open_brace) return fail("expected '{' after '" + word + "'");
+
+            if (!events.begin(word, name)) return fail(events.error());
+            depth++;
+        }
+
+        if (depth != 0) return fail("unexpected end of file inside a statement");
+        return true;
+    }
+
+    const std::string& error() const { return message; }
+
+private:
+    enum token_type { identifier, string_token, number_token, open_brace, close_brace, open_bracket,
+                      close_bracket, colon, end_of_file, error_token };
+
+    scene_input in;
+    scene_events& events;
+    std::string message;
+
+    bool fail(const std::string& why) {
+        if (message.empty()) message = "line " + std::to_string(in.line) + ": " + why;
+        return false;
+    }
+
+    void skip_space() {
+        while (true) {
+            int c = in.peek();
+            if (c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == ',') {
+                in.get();
+            } else if (c == '#') {
+                while (c != EOF && c != '\n') c = in.get();
+            } else if (c == '/') {
+                in.get();
+                if (in.peek() != '/') {  // a lone '/' isn't a comment
+                    fail("unexpected character '/'");
+                    return;
+                }
+                while (c != EOF && c != '\n') c = in.get();
+            } else {
+                return;
+            }
+        }
+    }
+
+    token_type next(std::string& token) {
+        skip_space();
+        token.clear();
+        if (!message.empty()) return error_token;
+
+        int c = in.get();
+        switch (c) {
+            case EOF: return end_of_file;
+            case '{': token = "{"; return open_brace;
+            case '}': token = "}"; return close_brace;
+            case '[': token = "["; return open_bracket;
+            case ']': token = "]"; return close_bracket;
+            case ':': token = ":"; return colon;
+        }
+
+        if (c == '"') {
+            for (c = in.get(); c != '"'; c = in.get()) {
+                if (c == EOF || c == '\n') {
+                    fail("unterminated string");
+                    return error_token;
+                }
+                if (c == '\\') c = in.get();
+                token += static_cast<char>(c);
+            }
+            return string_token;
+        }
+
+        if (std::isalpha(c) || c == '_') {
+            token += static_cast<char>(c);
+            while (std::isalnum(in.peek()) || in.peek() == '_') token += static_cast<char>(in.get());
+            return identifier;
+        }
+
+        if (std::isdigit(c) || c == '-' || c == '+' || c == '.') {
+            token += static_cast<char>(c);
+            for (int d = in.peek(); std::isalnum(d) || d == '+' || d == '-' || d == '.'; d = in.peek()) {
+                token += static_cast<char>(in.get());
+            }
+            return number_token;
+        }
+
+        fail(std::string("unexpected character '") + static_cast<char>(c) + "'");
+        return error_token;
+    }
+
+    bool to_number(const std::string& token, double& x) {
+        char* end;
+        errno = 0;
+        x = std::strtod(token.c_str(), &end);
+        if (*end != '\0' || errno == ERANGE) return fail("bad number '" + token + "'");
+        return true;
+    }
+
+    bool read_value(scene_value& value) {
+        std::string token;
+        token_type t = next(token);
+
+        if (t == number_token) {
+            value.type = scene_value::number;
+            value.count = 1;
+            return to_number(token, value.numbers[0]);
+        }
+        if (t == string_token) {
+            value.type = scene_value::string;
+            value.text = token;
+            return true;
+        }
+        if (t == identifier && (token == "true" || token == "false")) {
+            value.type = scene_value::boolean;
+            value.flag = token == "true";
+            return true;
+        }
+        if (t == open_bracket) {
+            value.type = scene_value::number;
+            value.count = 0;
+            for (t = next(token); t == number_token; t = next(token)) {
+                if (value.count == 3) return fail("more than three numbers in a vector");
+                if (!to_number(token, value.numbers[value.count++])) return false;
+            }
+            if (t != close_bracket) return fail("expected a number or ']'");
+            if (value.count == 0) return fail("empty vector");
+            return true;
+        }
+        if (t == error_token) return false;
+        return fail("expected a value, found '" + token + "'");
+    }
+};
+
+namespace scene_binary {
+    const char magic[8] = {'R', 'T', 'W', 'S', 'C', 'E', 'N', 'E'};
+    const uint32_t version = 1;
+
+    enum tag : uint8_t { begin_tag = 1, property_tag = 2, end_tag = 3 };
+}
+
+class scene_binary_parser {
+public:
+    scene_binary_parser(std::FILE* file, scene_events& events) : in(file), events(events) {}
+
+    bool parse() {
+        char magic[8];
+        uint32_t version;
+        if (!in.read(magic, 8) || std::memcmp(magic, scene_binary::magic, 8) != 0) return fail("not a binary scene file");
+        if (!in.read(&version, 4) || version != scene_binary::version) return fail("unsupported binary scene version");
+
+        int depth = 0;
+        std::string kind, name;
+        scene_value value;
+
+        while (true) {
+            uint8_t tag;
+            uint32_t length;
+            if (!in.read(&tag, 1)) break;
+            if (!in.read(&length, 4)) return fail("truncated record");
+            record_left = length;
+
+            if (tag == scene_binary::begin_tag) {
+                if (!read_string(kind) || !read_string(name)) return false;
+                if (!events.begin(kind, name)) return fail(events.error());
+                depth++;
+            } else if (tag == scene_binary::property_tag) {
+                if (depth == 0) return fail("property outside a statement");
+                if (!read_string(kind) || !read_value(value)) return false;
+                if (!events.property(kind, value)) return fail(events.error());
+            } else if (tag == scene_binary::end_tag) {
+                if (depth == 0) return fail("unmatched end");
+                depth--;
+                if (!events.end()) return fail(events.error());
+            }
+            // the rest of a record is for later versions, as is all of one with an unknown tag
+            if (!in.skip(record_left)) return fail("truncated record");
+            records++;
+        }
+
+        if (depth != 0) return fail("unexpected end of file inside a statement");
+        return true;
+    }
+
+    const std::string& error() const { return message; }
+
+private:
+    scene_input in;
+    scene_events& events;
+    std::string message;
+    size_t records = 0;
+    uint32_t record_left = 0;  // bytes of the current record not yet read
+
+    // Reads n bytes of the current record, false past its end or the file's
+    bool take(void* out, size_t n) {
+        if (n > record_left || !in.read(out, n)) return false;
+        record_left -= static_cast<uint32_t>(n);
+        return true;
+    }
+
+    bool fail(const std::string& why) {
+        if (message.empty()) message = "record " + std::to_string(records) + ": " + why;
+        return false;
+    }
+
+    bool read_string(std::string& s) {
+        uint16_t length;
+        if (!take(&length, 2)) return fail("truncated string");
+        s.resize(length);
+        return (length == 0 || take(&s[0], length)) || fail("truncated string");
+    }
+
+    bool read_value(scene_value& value) {
+        uint8_t type;
+        if (!take(&type, 1)) return fail("truncated value");
+
+        if (type == scene_value::number) {
+            uint8_t count;
+            if (!take(&count, 1) || count < 1 || count > 3) return fail("bad number count");
+            value.type = scene_value::number;
+            value.count = count;
+            return take(value.numbers, count * sizeof(double)) || fail("truncated value");
+        }
+        if (type == scene_value::string) {
+            value.type = scene_value::string;
+            return read_string(value.text);
+        }
+        if (type == scene_value::boolean) {
+            uint8_t flag;
+            if (!take(&flag, 1)) return fail("truncated value");
+            value.type = scene_value::boolean;
+            value.flag = flag != 0;
+            return true;
+        }
+        return fail("unknown value type");
+    }
+};
+
+// Writes the events it receives as a binary scene file
+class scene_binary_writer : public scene_events {
+public:
+    explicit scene_binary_writer(std::FILE* out) : out(out) {
+        ok = std::fwrite(scene_binary::magic, 1, 8, out) == 8 && std::fwrite(&scene_binary::version, 4, 1, out) == 1;
+    }
+
+    bool begin(const std::string& kind, const std::string& name) override {
+        record.clear();
+        put_string(kind);
+        put_string(name);
+        return flush(scene_binary::begin_tag);
+    }
+
+    bool property(const std::string& key, const scene_value& value) override {
+        record.clear();
+        put_string(key);
+        record.push_back(static_cast<char>(value.type));
+        if (value.type == scene_value::number) {
+            record.push_back(static_cast<char>(value.count));
+            put(value.numbers, value.count * sizeof(double));
+        } else if (value.type == scene_value::string) {
+            put_string(value.text);
+        } else {
+            record.push_back(value.flag ? 1 : 0);
+        }
+        return flush(scene_binary::property_tag);
+    }
+
+    bool end() override {
+        record.clear();
+        return flush(scene_binary::end_tag);
+    }
+
+    std::string error() const override {
+        return too_long ? "a string is longer than the binary form's 65535 bytes" : "could not write the binary scene";
+    }
+
+private:
+    std::FILE* out;
+    std::vector<char> record;
+    bool ok;
+    bool too_long = false;
+
+    void put(const void* data, size_t n) {
+        const char* bytes = static_cast<const char*>(data);
+        record.insert(record.end(), bytes, bytes + n);
+    }
+
+    // A string the u16 length can't hold fails the write rather than being cut short
+    void put_string(const std::string& s) {
+        if (s.size() > 65535) {
+            too_long = true;
+            ok = false;
+            return;
+        }
+        uint16_t length = static_cast<uint16_t>(s.size());
+        put(&length, 2);
+        put(s.data(), length);
+    }
+
+    bool flush(uint8_t tag) {
+        uint32_t length = static_cast<uint32_t>(record.size());
+        ok = ok && std::fwrite(&tag, 1, 1, out) == 1 && std::fwrite(&length, 4, 1, out) == 1
+                && std::fwrite(record.data(), 1, record.size(), out) == record.size();
+        return ok;
+    }
+};
+
+// Writes the events it receives as a text scene file, one property per line
+class scene_text_writer : public scene_events {
+public:
+    explicit scene_text_writer(std::FILE* out) : out(out) {}
+
+    bool begin(const std::string& kind, const std::string& name) override {
+        indent();
+        std::fprintf(out, "%s ", kind.c_str());
+        if (!name.empty()) std::fprintf(out, "%s ", quoted(name).c_str());
+        std::fprintf(out, "{\n");
+        depth++;
+        return !std::ferror(out);
+    }
+
+    bool property(const std::string& key, const scene_value& value) override {
+        indent();
+        std::fprintf(out, "%s: ", key.c_str());
+        if (value.type == scene_value::string) {
+            std::fprintf(out, "%s", quoted(value.text).c_str());
+        } else if (value.type == scene_value::boolean) {
+            std::fprintf(out, "%s", value.flag ? "true" : "false");
+        } else if (value.count == 1) {
+            std::fprintf(out, "%.17g", value.numbers[0]);
+        } else {
+            std::fprintf(out, "[");
+            for (int i = 0; i < value.count; i++) std::fprintf(out, i ? ", %.17g" : "%.17g", value.numbers[i]);
+            std::fprintf(out, "]");
+        }
+        std::fprintf(out, "\n");
+        return !std::ferror(out);
+    }
+
+    bool end() override {
+        depth--;
+        indent();
+        std::fprintf(out, "}\n");
+        return !std::ferror(out);
+    }
+
+    std::string error() const override { return "could not write the text scene"; }
+
+private:
+    std::FILE* out;
+    int depth = 0;
+
+    void indent() {
+        for (int i = 0; i < depth; i++) std::fputs("    ", out);
+    }
+
+    static std::string quoted(const std::string& s) {
+        std::string q = "\"";
+        for (char c : s) {
+            if (c == '"' || c == '\\') q += '\\';
+            q += c;
+        }
+        return q + "\"";
+    }
+};
+
+// Parses a scene file, text or binary by its first bytes, into events
+inline bool parse_scene_file(const std::string& filename, scene_events& events, std::string& error) {
+    std::FILE* file = std::fopen(filename.c_str(), "rb");
+    if (!file) {
+        error = "could not open the file";
+        return false;
+    }
+
+    char magic[8] = {0};
+    bool binary = std::fread(magic, 1, 8, file) == 8 && std::memcmp(magic, scene_binary::magic, 8) == 0;
+    std::rewind(file);
+
+    bool ok;
+    if (binary) {
+        scene_binary_parser parser(file, events);
+        ok = parser.parse();
+        error = parser.error();
+    } else {
+        scene_text_parser parser(file, events);
+        ok = parser.parse();
+        error = parser.error();
+    }
+
+    std::fclose(file);
+    return ok;
+}
+
+#endif
@@ -0,0 +1,390 @@
+#ifndef SCENE_LOADER_H
+#define SCENE_LOADER_H
+
+// Builds a scene from a scene file (see scene_file.h for the syntax).  The statements:
+//
+//   camera { ... }                   any of the camera's settings by name, plus environment: "file"
+//                                    and environment_intensity
+//   texture "name" { type: ... }     "solid" (color), "checker" (scale, even, odd), "image" (file),
+//                                    "noise" (scale, seed)
+//   material "name" { type: ... }    "lambertian" (albedo), "metal" (albedo, fuzz), "dielectric" (ir),
+//                                    "diffuse_light" (emit), "isotropic" (albedo)
+//   sphere { center, radius, material }          with center2 for a moving sphere
+//   quad { Q, u, v, material }
+//   box { a, b, material }
+//   constant_medium { density, albedo, ... }     bounded by the objects nested in it
+//   bvh { ... }                                  a bounding volume hierarchy over the objects nested in it,
+//                                                with cache: "file" to keep the built tree (see bvh_cache.h)
+//
+// Colours (albedo, emit, even, odd) are either [r, g, b] or the name of a texture, and materials and
+// textures must be declared before they're used.  Every object takes rotate_y (degrees about y) and
+// translate ([x, y, z]), applied in that order.  Objects with a diffuse_light material are also the
+// lights that next event estimation samples, moved with any bvh they're nested in (not a medium's
+// boundary, which isn't seen).
+
+#include "rtweekend.h"
+
+#include "box.h"
+#include "bvh.h"
+#include "bvh_cache.h"
+#include "camera.h"
+#include "constant_medium.h"
+#include "hittable_list.h"
+#include "light_bvh.h"
+#include "material.h"
+#include "quad.h"
+#include "scene.h"
+#include "scene_file.h"
+#include "sphere.h"
+#include "texture.h"
+#include "trace.h"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+class scene_builder : public scene_events {
+public:
+    bool begin(const std::string& kind, const std::string& name) override {
+        static const char* kinds[] = {"camera", "texture", "material", "sphere", "quad", "box", "constant_medium", "bvh"};
+        bool known = false;
+        for (const char* k : kinds) known = known || kind == k;
+        if (!known) return fail("unknown statement '" + kind + "'");
+
+        if (kind == "camera" && !stack.empty()) return fail("camera inside another statement");
+
+        stack.push_back(frame());
+        stack.back().kind = kind;
+        stack.back().name = name;
+        hash_text(kind);
+        hash_text(name);
+        return true;
+    }
+
+    bool property(const std::string& key, const scene_value& value) override {
+        stack.back().properties.push_back(std::make_pair(key, value));
+
+        // how many samples to take and where to keep them don't change the image a checkpoint is of
+        bool sampling = stack.back().kind == "camera"
+                     && (key == "samples_per_pixel" || key == "checkpoint" || key == "checkpoint_interval");
+        if (!sampling) {
+            hash_text(key);
+            source_hash = fnv1a(&value.type, sizeof(value.type), source_hash);
+            if (value.type == scene_value::number) source_hash = fnv1a(value.numbers, sizeof(double) * value.count, source_hash);
+            else if (value.type == scene_value::string) hash_text(value.text);
+            else source_hash = fnv1a(&value.flag, sizeof(value.flag), source_hash);
+        }
+        return true;
+    }
+
+    bool end() override {
+        hash_text("}");
+        frame& f = stack.back();
+        used.clear();
+        bool ok;
+
+        if (f.kind == "camera") ok = build_camera(f);
+        else if (f.kind == "texture") ok = build_texture(f);
+        else if (f.kind == "material") ok = build_material(f);
+        else ok = build_object(f);
+
+        if (ok) {
+            for (const auto& p : f.properties) {
+                if (!was_used(p.first)) return fail("unknown property '" + p.first + "' in " + f.kind);
+            }
+        }
+
+        stack.pop_back();
+        return ok;
+    }
+
+    std::string error() const override { return failure; }
+
+    // The scene built so far, all of it once the parse succeeds
+    scene result() const {
+        scene built(world, cam, lights.objects.empty() ? nullptr : make_shared<light_bvh>(lights));
+        built.cam.scene_hash = source_hash;  // for checkpoints, see camera.h
+        return built;
+    }
+
+    size_t object_count() const { return objects; }
+
+private:
+    struct frame {
+        std::string kind, name;
+        std::vector<std::pair<std::string, scene_value>> properties;
+        hittable_list children;
+        hittable_list lights;  // the emissive ones among the children, placed as they are in it
+    };
+
+    std::vector<frame> stack;
+    uint64_t source_hash = fnv1a(nullptr, 0);  // of the statements, in order
+    std::unordered_map<std::string, shared_ptr<texture>> textures;
+    std::unordered_map<std::string, shared_ptr<material>> materials;
+    hittable_list world, lights;
+    camera cam;
+    size_t objects = 0;
+    std::string failure;
+    std::vector<std::string> used;  // properties of the current statement that were read
+
+    void hash_text(const std::string& text) {
+        uint64_t length = text.size();
+        source_hash = fnv1a(text.data(), text.size(), fnv1a(&length, sizeof(length), source_hash));
+    }
+
+    bool fail(const std::string& why) {
+        failure = why;
+        return false;
+    }
+
+    bool was_used(const std::string& key) const {
+        for (const auto& k : used) {
+            if (k == key) return true;
+        }
+        return false;
+    }
+
+    // The last value given for key, or null
+    const scene_value* find(const frame& f, const char* key) {
+        used.push_back(key);
+        for (auto p = f.properties.rbegin(); p != f.properties.rend(); ++p) {
+            if (p->first == key) return &p->second;
+        }
+        return nullptr;
+    }
+
+    bool get_number(const frame& f, const char* key, double& x, bool required = false) {
+        const scene_value* v = find(f, key);
+        if (!v) return !required || fail(f.kind + " needs " + key);
+        if (v->type != scene_value::number || v->count != 1) return fail(std::string(key) + " should be a number");
+        x = v->numbers[0];
+        return true;
+    }
+
+    bool get_integer(const frame& f, const char* key, int& n) {
+        double x = n;
+        if (!get_number(f, key, x)) return false;
+        n = static_cast<int>(x);
+        return true;
+    }
+
+    bool get_vec3(const frame& f, const char* key, vec3& x, bool required = false) {
+        const scene_value* v = find(f, key);
+        if (!v) return !required || fail(f.kind + " needs " + key);
+        if (v->type != scene_value::number || v->count != 3) return fail(std::string(key) + " should be [x, y, z]");
+        x = v->as_vec3();
+        return true;
+    }
+
+    bool get_string(const frame& f, const char* key, std::string& s, bool required = false) {
+        const scene_value* v = find(f, key);
+        if (!v) return !required || fail(f.kind + " needs " + key);
+        if (v->type != scene_value::string) return fail(std::string(key) + " should be a string");
+        s = v->text;
+        return true;
+    }
+
+    // A colour as a solid texture, or a texture by name
+    bool texture_value(const frame& f, const char* key, shared_ptr<texture>& t) {
+        const scene_value* v = find(f, key);
+        if (!v) return fail(f.kind + " needs " + key);
+        if (v->type == scene_value::number && v->count == 3) {
+            t = make_shared<solid_color>(v->as_vec3());
+            return true;
+        }
+        if (v->type != scene_value::string) return fail(std::string(key) + " should be [r, g, b] or a texture name");
+
+        auto found = textures.find(v->text);
+        if (found == textures.end()) return fail("no texture named '" + v->text + "'");
+        t = found->second;
+        return true;
+    }
+
+    bool build_camera(const frame& f) {
+        std::string environment;
+        double intensity = 1;
+
+        bool ok = get_number(f, "aspect_ratio", cam.aspect_ratio)
+               && get_integer(f, "image_width", cam.image_width)
+               && get_integer(f, "samples_per_pixel", cam.samples_per_pixel)
+               && get_integer(f, "max_depth", cam.max_depth)
+               && get_vec3(f, "background", cam.background)
+               && get_number(f, "vfov", cam.vfov)
+               && get_vec3(f, "lookfrom", cam.lookfrom)
+               && get_vec3(f, "lookat", cam.lookat)
+               && get_vec3(f, "vup", cam.vup)
+               && get_number(f, "defocus_angle", cam.defocus_angle)
+               && get_number(f, "focus_dist", cam.focus_dist)
+               && get_string(f, "environment", environment)
+               && get_number(f, "environment_intensity", intensity)
+               && get_string(f, "checkpoint", cam.checkpoint)
+               && get_number(f, "checkpoint_interval", cam.checkpoint_interval);
+        if (!ok) return false;
+
+        if (!environment.empty()) cam.environment = make_shared<environment_map>(environment.c_str(), intensity);
+        return true;
+    }
+
+    bool build_texture(const frame& f) {
+        std::string type;
+        if (f.name.empty()) return fail("texture without a name");
+        if (!get_string(f, "type", type, true)) return false;
+
+        shared_ptr<texture> t;
+        if (type == "solid") {
+            if (!texture_value(f, "color", t)) return false;
+        } else if (type == "checker") {
+            double scale = 1;
+            shared_ptr<texture> even, odd;
+            if (!get_number(f, "scale", scale) || !texture_value(f, "even", even) || !texture_value(f, "odd", odd)) return false;
+            t = make_shared<checker_texture>(scale, even, odd);
+        } else if (type == "image") {
+            std::string file;
+            if (!get_string(f, "file", file, true)) return false;
+            t = make_shared<image_texture>(file.c_str());
+        } else if (type == "noise") {
+            double scale = 1, seed = 0;
+            if (!get_number(f, "scale", scale) || !get_number(f, "seed", seed)) return false;
+            t = make_shared<noise_texture>(scale, static_cast<unsigned int>(seed));
+        } else {
+            return fail("unknown texture type '" + type + "'");
+        }
+
+        textures[f.name] = t;
+        return true;
+    }
+
+    bool build_material(const frame& f) {
+        std::string type;
+        if (f.name.empty()) return fail("material without a name");
+        if (!get_string(f, "type", type, true)) return false;
+
+        shared_ptr<texture> t;
+        shared_ptr<material> m;
+        if (type == "lambertian") {
+            if (!texture_value(f, "albedo", t)) return false;
+            m = make_shared<lambertian>(t);
+        } else if (type == "metal") {
+            double fuzz = 0;
+            if (!texture_value(f, "albedo", t) || !get_number(f, "fuzz", fuzz)) return false;
+            m = make_shared<metal>(t, fuzz);
+        } else if (type == "dielectric") {
+            double ir = 1.5;
+            if (!get_number(f, "ir", ir, true)) return false;
+            m = make_shared<dielectric>(ir);
+        } else if (type == "diffuse_light") {
+            if (!texture_value(f, "emit", t)) return false;
+            m = make_shared<diffuse_light>(t);
+        } else if (type == "isotropic") {
+            if (!texture_value(f, "albedo", t)) return false;
+            m = make_shared<isotropic>(t);
+        } else {
+            return fail("unknown material type '" + type + "'");
+        }
+
+        materials[f.name] = m;
+        return true;
+    }
+
+    bool material_value(const frame& f, shared_ptr<material>& m) {
+        std::string name;
+        if (!get_string(f, "material", name, true)) return false;
+
+        auto found = materials.find(name);
+        if (found == materials.end()) return fail("no material named '" + name + "'");
+        m = found->second;
+        return true;
+    }
+
+    bool build_object(const frame& f) {
+        shared_ptr<hittable> object;
+        shared_ptr<material> mat;
+
+        if (f.kind == "sphere") {
+            vec3 center, center2;
+            double radius;
+            if (!get_vec3(f, "center", center, true) || !get_number(f, "radius", radius, true) || !material_value(f, mat)) return false;
+
+            if (find(f, "center2")) {
+                if (!get_vec3(f, "center2", center2)) return false;
+                object = make_shared<sphere>(center, center2, radius, mat);
+            } else {
+                object = make_shared<sphere>(center, radius, mat);
+            }
+        } else if (f.kind == "quad") {
+            vec3 Q, u, v;
+            if (!get_vec3(f, "Q", Q, true) || !get_vec3(f, "u", u, true) || !get_vec3(f, "v", v, true) || !material_value(f, mat)) return false;
+            object = make_shared<quad>(Q, u, v, mat);
+        } else if (f.kind == "box") {
+            vec3 a, b;
+            if (!get_vec3(f, "a", a, true) || !get_vec3(f, "b", b, true) || !material_value(f, mat)) return false;
+            object = make_shared<box>(a, b, mat);
+        } else if (f.kind == "constant_medium") {
+            double density;
+            shared_ptr<texture> albedo;
+            if (!get_number(f, "density", density, true) || !texture_value(f, "albedo", albedo)) return false;
+            if (f.children.objects.empty()) return fail("constant_medium without a boundary");
+
+            auto boundary = f.children.objects.size() == 1 ? f.children.objects[0] : make_shared<hittable_list>(f.children);
+            object = make_shared<constant_medium>(boundary, density, albedo);
+        } else {  // bvh
+            std::string cache;
+            if (!get_string(f, "cache", cache)) return false;
+            if (f.children.objects.empty()) {
+                used.push_back("rotate_y");
+                used.push_back("translate");
+                return true;
+            }
+            object = cache.empty() ? shared_ptr<hittable>(make_shared<bvh_node>(f.children)) : cached_bvh(f.children, cache);
+        }
+
+        double angle = 0;
+        vec3 offset(0, 0, 0);
+        if (!get_number(f, "rotate_y", angle) || !get_vec3(f, "translate", offset)) return false;
+        object = placed(object, angle, offset);
+
+        // the light this object is, or the ones nested in a bvh moved with it (a medium's boundary
+        // isn't seen, so it doesn't light anything)
+        std::vector<shared_ptr<hittable>> placed_lights;
+        if (std::dynamic_pointer_cast<diffuse_light>(mat) && object->emission_bounds().phi > 0) placed_lights.push_back(object);
+        if (f.kind == "bvh") {
+            for (const auto& light : f.lights.objects) placed_lights.push_back(placed(light, angle, offset));
+        }
+
+        // a top level object goes in the world, a nested one in the statement it's nested in, and the
+        // lights are only sampled once they're where the top level object puts them
+        frame* parent = stack.size() > 1 ? &stack[stack.size() - 2] : nullptr;
+        (parent ? parent->children : world).add(object);
+        for (const auto& light : placed_lights) (parent ? parent->lights : lights).add(light);
+        objects++;
+        return true;
+    }
+
+    static shared_ptr<hittable> placed(shared_ptr<hittable> object, double angle, const vec3& offset) {
+        if (angle != 0) object = make_shared<rotate_y>(object, angle);
+        if (offset.length_squared() > 0) object = make_shared<translate>(object, offset);
+        return object;
+    }
+};
+
+// The scene in a text or binary scene file, or null (after saying why) when it can't be read
+inline shared_ptr<scene> load_scene(const std::string& filename) {
+    trace::span span("scene load", filename);
+    auto start = std::chrono::steady_clock::now();
+
+    scene_builder builder;
+    std::string error;
+    if (!parse_scene_file(filename, builder, error)) {
+        std::cerr << "ERROR: Could not load the scene '" << filename << "': " << error << ".\n";
+        return nullptr;
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::clog << "Loaded " << builder.object_count() << " objects from " << filename << " in " << elapsed.count() << "s\n";
+    return make_shared<scene>(builder.result());
+}
+
+#endif
@@ -0,0 +1,578 @@
+#ifndef SCENES_H
+#define SCENES_H
+
+// The built in scenes, shared by main.cpp and the benchmarks in ../bench
+
+#include "rtweekend.h"
+#include "camera.h"
+#include "color.h"
+#include "hittable_list.h"
+#include "material.h"
+#include "sphere.h"
+#include "bvh.h"
+#include "box.h"
+#include "texture.h"
+#include "quad.h"
+#include "constant_medium.h"
+#include "heterogeneous_medium.h"
+#include "light_bvh.h"
+#include "scene.h"
+
+#include <functional>
+#include <vector>
+
+
+inline scene debug_world() {
+    hittable_list world;
+
+    auto material_ground = make_shared<lambertian>(color(0.8, 0.8, 0.0));
+    auto material_center = make_shared<lambertian>(color(0.1, 0.2, 0.5));
+    auto material_left   = make_shared<dielectric>(1.5);
+    auto material_right  = make_shared<metal>(color(0.8, 0.6, 0.2), 0.0);
+
+    world.add(make_shared<sphere>(point3( 0.0, -100.5, -1.0), 100, material_ground));
+    world.add(make_shared<sphere>(point3( 0.0,    0.0, -1.0), 0.5, material_center));
+    world.add(make_shared<sphere>(point3(-1.2,    0.0, -1.0), 0.5, material_left));
+    world.add(make_shared<sphere>(point3(-1.0, 0.0, -1.0), -0.4, material_left));  // Negative radius leaves geometry the same, but makes the surface normal point inwards (used to make a hollow glass sphere)
+    world.add(make_shared<sphere>(point3( 1.0, 0.0, -1.0), 0.5, material_right));
+
+    camera cam;
+    cam.aspect_ratio      = 16.0 / 9.0;
+    cam.image_width       = 400;
+    cam.samples_per_pixel = 100;
+    cam.max_depth         = 50;
+    cam.background        = color(0.7, 0.8, 1.0);
+
+    cam.vfov     = 20;
+    cam.lookfrom = point3(-2, 2, 1);
+    cam.lookat   = point3(0,0,-1);
+    cam.vup      = vec3(0,1,0);
+
+    cam.defocus_angle = 10.0;
+    cam.focus_dist    = 3.4;
+
+    return scene(world, cam);
+}
+
+
+inline scene random_spheres() {
+    hittable_list world;
+
+    auto checker = make_shared<checker_texture>(0.32, color(.2, .3, .1), color(.9, .9, .9));
+    auto ground_material = make_shared<lambertian>(checker);
+    world.add(make_shared<sphere>(point3(0, -1000, 0), 1000, ground_material));
+
+    for (int a = -11; a < 11; a++) {
+        for (int b = -11; b < 11; b++) {
+            auto choose_mat = random_double();
+            point3 center(a + 0.9*random_double(), 0.2, b + 0.9*random_double());
+
+            if ((center - point3(4, 0.2, 0)).length() > 0.9) {
+                shared_ptr<material> sphere_material;
+
+                if (choose_mat < 0.8) {
+                    // diffuse
+                    auto albedo = color::random() * color::random();
+                    sphere_material = make_shared<lambertian>(albedo);
+                    vec3 center2 = center + vec3(0, random_double(0, .5), 0);
+                    world.add(make_shared<sphere>(center, center2, 0.2, sphere_material));
+                } else if (choose_mat < 0.95) {
+                    // metal
+                    auto albedo = color::random(0.5, 1);
+                    auto fuzz = random_double(0, 0.5);
+                    sphere_material = make_shared<metal>(albedo, fuzz);
+                    world.add(make_shared<sphere>(center, 0.2, sphere_material));
+                } else {
+                    // glass
+                    sphere_material = make_shared<dielectric>(1.5);
+                    world.add(make_shared<sphere>(center, 0.2, sphere_material));
+                }
+            }
+        }
+    }
+
+    // ray r()
+
+    auto material1 = make_shared<dielectric>(1.5);
+    world.add(make_shared<sphere>(point3(0, 1, 0), 1.0, material1));
+
+    auto material2 = make_shared<lambertian>(color(0.4, 0.2, 0.1));
+    world.add(make_shared<sphere>(point3(-4, 1, 0), 1.0, material2));
+
+    auto material3 = make_shared<metal>(color(0.7, 0.6, 0.5), 0.0);
+    world.add(make_shared<sphere>(point3(4, 1, 0), 1.0, material3));
+
+    world = hittable_list(make_shared<bvh_node>(world));
+
+    camera cam;
+    cam.aspect_ratio      = 16.0 / 9.0;
+    cam.image_width       = 400;  // increase to 1200 for final render
+    cam.samples_per_pixel = 100;  // increase to 500 for final render
+    cam.max_depth         = 50;
+    cam.background        = color(0.7, 0.8, 1.0);
+
+    cam.vfov     = 20;
+    cam.lookfrom = point3(13, 2, 3);
+    cam.lookat   = point3(0,0,0);
+    cam.vup      = vec3(0,1,0);
+
+    cam.defocus_angle = 0.6;
+    cam.focus_dist    = 10.0;
+
+    return scene(world, cam);
+}
+
+
+inline scene two_spheres() {
+    hittable_list world;
+
+    auto checker = make_shared<checker_texture>(0.32, color(.2, .3, .1), color(.9, .9, .9));
+
+    world.add(make_shared<sphere>(point3(0,-10,0), 10, make_shared<lambertian>(checker)));
+    world.add(make_shared<sphere>(point3(0, 10,0), 10, make_shared<lambertian>(checker)));
+
+    camera cam;
+    cam.aspect_ratio      = 16.0 / 9.0;
+    cam.image_width       = 400;  // increase to 1200 for final render
+    cam.samples_per_pixel = 100;  // increase to 500 for final render
+    cam.max_depth         = 50;
+    cam.background        = color(0.7, 0.8, 1.0);
+
+    cam.vfov     = 20;
+    cam.lookfrom = point3(13, 2, 3);
+    cam.lookat   = point3(0,0,0);
+    cam.vup      = vec3(0,1,0);
+
+    cam.defocus_angle = 0.6;
+    cam.focus_dist    = 10.0;
+
+    return scene(world, cam);
+}
+
+
+inline scene earth() {
+    auto earth_texture = make_shared<image_texture>("earthmap.gif");
+    auto earth_surface = make_shared<lambertian>(earth_texture);
+    auto globe = make_shared<sphere>(point3(0,0,0), 2, earth_surface);
+
+    camera cam;
+    cam.aspect_ratio      = 16.0 / 9.0;
+    cam.image_width       = 800;  // increase to 1200 for final render
+    cam.samples_per_pixel = 100;  // increase to 500 for final render
+    cam.max_depth         = 50;
+    cam.background        = color(0.7, 0.8, 1.0);
+
+    cam.vfov     = 20;
+    cam.lookfrom = point3(0, 0, 12);
+    cam.lookat   = point3(0,0,0);
+    cam.vup      = vec3(0,1,0);
+
+    cam.defocus_angle = 0;
+
+    return scene(hittable_list(globe), cam);
+}
+
+
+inline scene two_perlin_spheres() {
+    hittable_list world;
+
+    auto pertext = make_shared<noise_texture>(1);
+    world.add(make_shared<sphere>(point3(0,-1000,0), 1000, make_shared<lambertian>(pertext)));
+    world.add(make_shared<sphere>(point3(0, 2,0), 2, make_shared<lambertian>(pertext)));
+
+    camera cam;
+    cam.aspect_ratio      = 16.0 / 9.0;
+    cam.image_width       = 400;  // increase to 1200 for final render
+    cam.samples_per_pixel = 100;  // increase to 500 for final render
+    cam.max_depth         = 50;
+    cam.background        = color(0.7, 0.8, 1.0);
+
+    cam.vfov     = 20;
+    cam.lookfrom = point3(13, 2, 3);
+    cam.lookat   = point3(0,0,0);
+    cam.vup      = vec3(0,1,0);
+
+    cam.defocus_angle = 0;
+
+    return scene(world, cam);
+}
+
+
+inline scene quads() {
+    hittable_list world;
+
+    // Materials
+    auto left_red     = make_shared<lambertian>(color(1.0, 0.2, 0.2));
+    auto back_green   = make_shared<lambertian>(color(0.2, 1.0, 0.2));
+    auto right_blue   = make_shared<lambertian>(color(0.2, 0.2, 1.0));
+    auto upper_orange = make_shared<lambertian>(color(1.0, 0.5, 0.0));
+    auto lower_teal   = make_shared<lambertian>(color(0.2, 0.8, 0.8));
+
+    // Quads
+    world.add(make_shared<quad>(point3(-3,-2, 5), vec3(0, 0,-4), vec3(0, 4, 0), left_red));
+    world.add(make_shared<quad>(point3(-2,-2, 0), vec3(4, 0, 0), vec3(0, 4, 0), back_green));
+    world.add(make_shared<quad>(point3( 3,-2, 1), vec3(0, 0, 4), vec3(0, 4, 0), right_blue));
+    world.add(make_shared<quad>(point3(-2, 3, 1), vec3(4, 0, 0), vec3(0, 0, 4), upper_orange));
+    world.add(make_shared<quad>(point3(-2,-3, 5), vec3(4, 0, 0), vec3(0, 0,-4), lower_teal));
+
+    camera cam;
+    cam.aspect_ratio      = 1.0;
+    cam.image_width       = 200;  // increase to 1200 for final render
+    cam.samples_per_pixel = 100;  // increase to 500 for final render
+    cam.max_depth         = 50;
+    cam.background        = color(0.7, 0.8, 1.0);
+
+    cam.vfov     = 80;
+    cam.lookfrom = point3(0,0,9);
+    cam.lookat   = point3(0,0,0);
+    cam.vup      = vec3(0,1,0);
+
+    cam.defocus_angle = 0;
+
+    return scene(world, cam);
+}
+
+
+inline scene simple_light() {
+    hittable_list world;
+
+    auto pertext = make_shared<noise_texture>(4);
+    world.add(make_shared<sphere>(point3(0, -1000, 0), 1000, make_shared<lambertian>(pertext)));
+    world.add(make_shared<sphere>(point3(0, 2, 0), 2, make_shared<lambertian>(pertext)));
+
+    auto difflight = make_shared<diffuse_light>(color(4,4,4));
+    hittable_list lights;
+    lights.add(make_shared<quad>(point3(3,1,-2), vec3(2,0,0), vec3(0,2,0), difflight));
+    lights.add(make_shared<sphere>(point3(0,7,0), 2, difflight));
+    for (const auto& light : lights.objects) world.add(light);
+
+    camera cam;
+    cam.aspect_ratio      = 16.0 / 9.0;
+    cam.image_width       = 400;  // increase to 1200 for final render
+    cam.samples_per_pixel = 100;  // increase to 500 for final render
+    cam.max_depth         = 50;
+    cam.background        = color(0,0,0);
+
+    cam.vfov     = 20;
+    cam.lookfrom = point3(26, 3, 6);
+    cam.lookat   = point3(0,2,0);
+    cam.vup      = vec3(0,1,0);
+
+    cam.defocus_angle = 0;
+
+    return scene(world, cam, make_shared<light_bvh>(lights));
+}
+
+
+inline scene cornell_box() {
+    hittable_list world;
+
+    auto red   = make_shared<lambertian>(color(.65, .05, .05));
+    auto white = make_shared<lambertian>(color(.73, .73, .73));
+    auto green = make_shared<lambertian>(color(.12, .45, .15));
+    auto light = make_shared<diffuse_light>(color(15, 15, 15));
+
+    world.add(make_shared<quad>(point3(555, 0, 0), vec3(0, 555, 0), vec3(0,0,555), green));
+    world.add(make_shared<quad>(point3(0, 0, 0), vec3(0, 555, 0), vec3(0,0,555), red));
+    auto ceiling_light = make_shared<quad>(point3(343, 554, 332), vec3(-130, 0, 0), vec3(0,0,-105), light);
+    world.add(ceiling_light);
+    world.add(make_shared<quad>(point3(0,0,0), vec3(555, 0, 0), vec3(0,0,555), white));
+    world.add(make_shared<quad>(point3(555,555,555), vec3(-555, 0, 0), vec3(0,0,-555), white));
+    world.add(make_shared<quad>(point3(0,0,555), vec3(555, 0, 0), vec3(0,555,0), white));
+
+    shared_ptr<hittable> box1 = make_shared<box>(point3(0,0,0), point3(165, 330, 165), white);
+    box1 = make_shared<rotate_y>(box1, 15);
+    box1 = make_shared<translate>(box1, vec3(265,0,295));
+    world.add(box1);
+
+    shared_ptr<hittable> box2 = make_shared<box>(point3(0,0,0), point3(165, 165, 165), white);
+    box1 = make_shared<rotate_y>(box1, -18);
+    box1 = make_shared<translate>(box1, vec3(130,0,65));
+    world.add(box2);
+
+    camera cam;
+    cam.aspect_ratio      = 1.0;
+    cam.image_width       = 200;  // increase to 1200 for final render
+    cam.samples_per_pixel = 200;  // increase to 500 for final render
+    cam.max_depth         = 50;
+    cam.background        = color(0,0,0);
+
+    cam.vfov     = 40;
+    cam.lookfrom = point3(278, 278, -800);
+    cam.lookat   = point3(278, 278, 0);
+    cam.vup      = vec3(0,1,0);
+
+    cam.defocus_angle = 0;
+
+    return scene(world, cam, make_shared<light_bvh>(hittable_list(ceiling_light)));
+}
+
+
+inline scene cornell_smoke() {
+    hittable_list world;
+
+    auto red   = make_shared<lambertian>(color(.65, .05, .05));
+    auto white = make_shared<lambertian>(color(.73, .73, .73));
+    auto green = make_shared<lambertian>(color(.12, .45, .15));
+    auto light = make_shared<diffuse_light>(color(7, 7, 7));
+
+    world.add(make_shared<quad>(point3(555, 0, 0), vec3(0, 555, 0), vec3(0,0,555), green));
+    world.add(make_shared<quad>(point3(0, 0, 0), vec3(0, 555, 0), vec3(0,0,555), red));
+    auto ceiling_light = make_shared<quad>(point3(113, 554, 127), vec3(330, 0, 0), vec3(0,0,305), light);
+    world.add(ceiling_light);
+    world.add(make_shared<quad>(point3(0,0,0), vec3(555, 0, 0), vec3(0,0,555), white));
+    world.add(make_shared<quad>(point3(555,555,555), vec3(-555, 0, 0), vec3(0,0,-555), white));
+    world.add(make_shared<quad>(point3(0,0,555), vec3(555, 0, 0), vec3(0,555,0), white));
+
+    shared_ptr<hittable> box1 = make_shared<box>(point3(0,0,0), point3(165, 330, 165), white);
+    box1 = make_shared<rotate_y>(box1, 15);
+    box1 = make_shared<translate>(box1, vec3(265,0,295));
+
+    shared_ptr<hittable> box2 = make_shared<box>(point3(0,0,0), point3(165, 165, 165), white);
+    box2 = make_shared<rotate_y>(box2, -18);
+    box2 = make_shared<translate>(box2, vec3(130,0,65));
+
+    world.add(make_shared<constant_medium>(box1, 0.01, color(0,0,0)));
+    world.add(make_shared<constant_medium>(box2, 0.01, color(1,1,1)));
+
+    camera cam;
+    cam.aspect_ratio      = 1.0;
+    cam.image_width       = 200;  // increase to 1200 for final render
+    cam.samples_per_pixel = 100;  // increase to 500 for final render
+    cam.max_depth         = 50;
+    cam.background        = color(0,0,0);
+
+    cam.vfov     = 40;
+    cam.lookfrom = point3(278, 278, -800);
+    cam.lookat   = point3(278,278,0);
+    cam.vup      = vec3(0,1,0);
+
+    cam.defocus_angle = 0;
+
+    return scene(world, cam, make_shared<light_bvh>(hittable_list(ceiling_light)));
+}
+
+
+inline scene final_scene(int image_width, int samples_per_pixel, int max_depth) {
+    hittable_list boxes1;
+    auto ground = make_shared<lambertian>(color(0.48, 0.83, 0.53));
+
+    int boxes_per_side = 20;
+    for (int i = 0; i < boxes_per_side; i++) {
+        for (int j = 0; j < boxes_per_side; j++) {
+            double w = 100.0;
+            double x0 = -1000.0 + i*w;
+            double z0 = -1000.0 + j*w;
+            double y0 = 0.0;
+
+            double x1 = x0 + w;
+            double y1 = random_double(1, 101);
+            double z1 = z0 + w;
+
+            boxes1.add(make_shared<box>(point3(x0,y0,z0), point3(x1, y1, z1), ground));
+        }
+    }
+
+    hittable_list world;
+
+    world.add(make_shared<bvh_node>(boxes1));
+
+    auto light = make_shared<diffuse_light>(color(7,7,7));
+    auto ceiling_light = make_shared<quad>(point3(123,554,147), vec3(300,0,0), vec3(0,0,265), light);
+    world.add(ceiling_light);
+
+    // Moving sphere
+    auto center1 = point3(400, 400, 200);
+    auto center2 = center1 + vec3(30, 0, 0);
+    auto sphere_material = make_shared<lambertian>(color(0.7, 0.3, 0.1));
+    world.add(make_shared<sphere>(center1, center2, 50, sphere_material));
+
+    world.add(make_shared<sphere>(point3(260, 150, 45), 50, make_shared<dielectric>(1.5)));
+    world.add(make_shared<sphere>(point3(0, 150, 145), 50, make_shared<metal>(color(0.8, 0.8, 0.8), 1.0)));
+
+    auto boundary = make_shared<sphere>(point3(360, 150, 145), 70, make_shared<dielectric>(1.5));
+    world.add(boundary);
+    world.add(make_shared<constant_medium>(boundary, 0.2, color(0.2, 0.4, 0.9)));
+
+    boundary = make_shared<sphere>(point3(0,0,0), 5000, make_shared<dielectric>(1.5));
+    world.add(make_shared<constant_medium>(boundary, .0001, color(1,1,1)));
+
+    // Earth globe
+    auto emat = make_shared<lambertian>(make_shared<image_texture>("earthmap.png"));
+    world.add(make_shared<sphere>(point3(400,200,400), 100, emat));
+
+    auto pertext = make_shared<noise_texture>(0.1);
+    world.add(make_shared<sphere>(point3(220,280,300), 80, make_shared<lambertian>(pertext)));
+
+
+    hittable_list boxes2;
+    auto white = make_shared<lambertian>(color(.73,.73,.73));
+    int ns = 1000;
+    for (int i = 0; i < ns; i++) {
+        boxes2.add(make_shared<sphere>(point3::random(0,165), 10, white));
+    }
+
+    world.add(make_shared<translate>(
+        make_shared<rotate_y>(
+            make_shared<bvh_node>(boxes2)
+            , 15)
+        , vec3(-100, 270, 395)));
+
+
+    camera cam;
+    cam.aspect_ratio      = 1.0;
+    cam.image_width       = image_width;  // increase to 1200 for final render
+    cam.samples_per_pixel = samples_per_pixel;  // increase to 500 for final render
+    cam.max_depth         = max_depth;
+    cam.background        = color(0,0,0);
+
+    cam.vfov     = 40;
+    cam.lookfrom = point3(478, 278, -600);
+    cam.lookat   = point3(278,278,0);
+    cam.vup      = vec3(0,1,0);
+
+    cam.defocus_angle = 0;
+
+    return scene(world, cam, make_shared<light_bvh>(hittable_list(ceiling_light)));
+}
+
+
+inline scene many_lights() {
+    hittable_list world;
+    hittable_list lights;
+
+    auto ground = make_shared<lambertian>(color(0.5, 0.5, 0.5));
+    world.add(make_shared<sphere>(point3(0, -1000, 0), 1000, ground));
+
+    auto pertext = make_shared<noise_texture>(4);
+    world.add(make_shared<sphere>(point3(0, 2, 0), 2, make_shared<lambertian>(pertext)));
+
+    // grid of small glowing spheres of random colour and strength
+    for (int a = -15; a < 15; a++) {
+        for (int b = -15; b < 15; b++) {
+            point3 center(a + 0.8*random_double(), 0.15, b + 0.8*random_double());
+            if ((center - point3(0, 0.15, 0)).length() < 2.5) continue;
+
+            auto glow = make_shared<diffuse_light>(random_double(1, 10) * color::random(0.2, 1));
+            lights.add(make_shared<sphere>(center, 0.15, glow));
+        }
+    }
+
+    for (const auto& light : lights.objects) world.add(light);
+    world = hittable_list(make_shared<bvh_node>(world));
+
+    camera cam;
+    cam.aspect_ratio      = 16.0 / 9.0;
+    cam.image_width       = 400;
+    cam.samples_per_pixel = 100;
+    cam.max_depth         = 50;
+    cam.background        = color(0,0,0);
+
+    cam.vfov     = 30;
+    cam.lookfrom = point3(20, 6, 12);
+    cam.lookat   = point3(0,1,0);
+    cam.vup      = vec3(0,1,0);
+
+    cam.defocus_angle = 0;
+
+    return scene(world, cam, make_shared<light_bvh>(lights));
+}
+
+
+inline scene cornell_perlin_smoke() {
+    hittable_list world;
+
+    auto red   = make_shared<lambertian>(color(.65, .05, .05));
+    auto white = make_shared<lambertian>(color(.73, .73, .73));
+    auto green = make_shared<lambertian>(color(.12, .45, .15));
+    auto light = make_shared<diffuse_light>(color(7, 7, 7));
+
+    world.add(make_shared<quad>(point3(555, 0, 0), vec3(0, 555, 0), vec3(0,0,555), green));
+    world.add(make_shared<quad>(point3(0, 0, 0), vec3(0, 555, 0), vec3(0,0,555), red));
+    auto ceiling_light = make_shared<quad>(point3(113, 554, 127), vec3(330, 0, 0), vec3(0,0,305), light);
+    world.add(ceiling_light);
+    world.add(make_shared<quad>(point3(0,0,0), vec3(555, 0, 0), vec3(0,0,555), white));
+    world.add(make_shared<quad>(point3(555,555,555), vec3(-555, 0, 0), vec3(0,0,-555), white));
+    world.add(make_shared<quad>(point3(0,0,555), vec3(555, 0, 0), vec3(0,555,0), white));
+
+    // billowing Perlin smoke, and the same smoke baked into a density grid
+    aabb cloud1(point3(60, 0, 150), point3(260, 400, 400));
+    world.add(make_shared<heterogeneous_medium>(make_shared<perlin_density>(0.05, 0.02), cloud1, color(1,1,1)));
+
+    aabb cloud2(point3(300, 0, 100), point3(500, 250, 350));
+    perlin noise(1);
+    auto grid = grid_density::sample(cloud2, 64, 64, 64, [&](const point3& p) {
+        double height = (p.y() - cloud2.y.min) / cloud2.y.size();
+        return 0.04 * (1 - height) * noise.turb(0.03 * p);
+    });
+    world.add(make_shared<heterogeneous_medium>(grid, cloud2, color(0.8, 0.6, 0.4)));
+
+    camera cam;
+    cam.aspect_ratio      = 1.0;
+    cam.image_width       = 200;  // increase to 1200 for final render
+    cam.samples_per_pixel = 100;  // increase to 500 for final render
+    cam.max_depth         = 50;
+    cam.background        = color(0,0,0);
+
+    cam.vfov     = 40;
+    cam.lookfrom = point3(278, 278, -800);
+    cam.lookat   = point3(278,278,0);
+    cam.vup      = vec3(0,1,0);
+
+    cam.defocus_angle = 0;
+
+    return scene(world, cam, make_shared<light_bvh>(hittable_list(ceiling_light)));
+}
+
+
+inline scene environment_lit() {
+    hittable_list world;
+
+    auto checker = make_shared<checker_texture>(0.32, color(.2, .3, .1), color(.9, .9, .9));
+    world.add(make_shared<sphere>(point3(0, -1000, 0), 1000, make_shared<lambertian>(checker)));
+    world.add(make_shared<sphere>(point3(-4, 1, 0), 1.0, make_shared<lambertian>(color(0.4, 0.2, 0.1))));
+    world.add(make_shared<sphere>(point3(0, 1, 0), 1.0, make_shared<dielectric>(1.5)));
+    world.add(make_shared<sphere>(point3(4, 1, 0), 1.0, make_shared<metal>(color(0.7, 0.6, 0.5), 0.0)));
+
+    camera cam;
+    cam.aspect_ratio      = 16.0 / 9.0;
+    cam.image_width       = 400;
+    cam.samples_per_pixel = 32;
+    cam.max_depth         = 50;
+    cam.environment       = make_shared<environment_map>("earthmap.png", 1.5);  // any lat-long .hdr/.pfm works here
+
+    cam.vfov     = 20;
+    cam.lookfrom = point3(13, 2, 3);
+    cam.lookat   = point3(0,0,0);
+    cam.vup      = vec3(0,1,0);
+
+    cam.defocus_angle = 0;
+
+    return scene(world, cam);
+}
+
+
+struct named_scene {
+    const char* name;
+    std::function<scene()> build;
+};
+
+// Every scene main() can pick, in the order of its switch
+inline std::vector<named_scene> builtin_scenes() {
+    return {
+        {"random_spheres",       random_spheres},
+        {"two_spheres",          two_spheres},
+        {"earth",                earth},
+        {"two_perlin_spheres",   two_perlin_spheres},
+        {"quads",                quads},
+        {"simple_light",         simple_light},
+        {"cornell_box",          cornell_box},
+        {"cornell_smoke",        cornell_smoke},
+        {"final_scene",          []() { return final_scene(400, 200, 4); }},
+        {"many_lights",          many_lights},
+        {"cornell_perlin_smoke", cornell_perlin_smoke},
+        {"environment_lit",      environment_lit},
+    };
+}
+
+#endif
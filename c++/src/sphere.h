@@ -2,6 +2,10 @@
 #define SPHERE_H
 
 #include "hittable.h"
+#include "fast_math.h"
+#include "material.h"
+#include "onb.h"
+#include "stats.h"
 #include "vec3.h"
 
 class sphere : public hittable {
@@ -25,20 +29,40 @@ public:
         }
 
     bool hit(const ray &r, interval ray_t, hit_record &rec) const override {
+        RTW_STAT(primitive_tests[stat_sphere]);
         point3 center = is_moving? sphere_center(r.time()) : center1;
         vec3 oc = r.origin() - center;  // A-C
-        double a = r.direction().length_squared();  // b^2
-        double h = dot(r.direction(), oc); // b.(A-C)
-        double c = oc.length_squared() - radius*radius;
+        real a = r.direction().length_squared();  // b^2
+        real h = dot(r.direction(), oc); // b.(A-C)
+        real c = oc.length_squared() - radius*radius;
+        real inv_a = 1 / a;
 
-        double discriminant = h*h - a*c;
+        // h*h - a*c loses most of its digits to cancellation for small or distant spheres (badly so
+        // in float), a*(r^2 - |l|^2) with l the vector from the center to the closest point on the
+        // line is the same value without that cancellation
+        vec3 l = oc - (h * inv_a) * r.direction();
+        real discriminant = a * (radius*radius - l.length_squared());
         if (discriminant < 0) return false;  // no solutions
-        double sqrtd = sqrt(discriminant);
+        real sqrtd = sqrt(discriminant);
+
+        // both roots without subtracting nearly equal values: q/a and c/q
+        real q = -(h + std::copysign(sqrtd, h));
+        real root0 = q * inv_a;
+        real root1 = (q != 0) ? c / q : root0;
+        if (root0 > root1) std::swap(root0, root1);
+
+        // A ray leaving the surface has c = |A-C|^2 - r^2 ~ 0 up to a rounding error relative to r^2, which
+        // for a big sphere can put its own origin further along the ray than any relative min_t(), so
+        // take the root nearest zero to be exactly the origin
+        if (fabs(c) <= 64 * std::numeric_limits<real>::epsilon() * (oc.length_squared() + radius*radius)) {
+            if (fabs(root0) < fabs(root1)) root0 = 0;
+            else root1 = 0;
+        }
 
         // find the closest solution/root, t, to the camera that lies in the acceptable range
-        double root = (-h - sqrtd) / a;
+        real root = root0;
         if (!ray_t.surrounds(root)) {  // closest (smallest) root is out of range
-            root = (-h + sqrtd) / a;
+            root = root1;
             if (!ray_t.surrounds(root)) { // largest root is also out of range
                 return false;
             }
@@ -49,6 +73,7 @@ public:
         vec3 outward_normal = (rec.p - center) / radius;
         rec.set_face_normal(r, outward_normal);
         get_sphere_uv(outward_normal, rec.u, rec.v);
+        rec.uv_width = r.spread() * rec.t * r.direction().length() / (pi * fabs(radius));  // v spans half a great circle
         rec.mat = mat;
 
         return true;
@@ -56,27 +81,73 @@ public:
 
     aabb bounding_box() const override { return bbox; }
 
+    double pdf_value(const point3& origin, const vec3& direction) const override {
+        // This method only works for stationary spheres
+        hit_record rec;
+        ray r(origin, direction);
+        if (!this->hit(r, interval(r.min_t(), infinity), rec)) return 0;
+
+        double distance_squared = (center1 - origin).length_squared();
+        if (distance_squared <= radius*radius) return 1 / (4*pi);  // origin inside, uniform over the sphere of directions
+
+        double cos_theta_max = sqrt(1 - radius*radius/distance_squared);
+        double solid_angle = 2*pi*(1-cos_theta_max);
+
+        return 1 / solid_angle;
+    }
+
+    vec3 random(const point3& origin) const override {
+        vec3 direction = center1 - origin;
+        double distance_squared = direction.length_squared();
+        if (distance_squared <= radius*radius) return random_unit_vector();
+
+        onb uvw;
+        uvw.build_from_w(direction);
+        return uvw.local(random_to_sphere(radius, distance_squared));
+    }
+
+    light_bounds emission_bounds() const override {
+        light_bounds lb;
+        double area = 4*pi*radius*radius;
+        lb.bounds = bbox;
+        lb.phi = pi * area * luminance(mat->emitted(0.5, 0.5, center1));
+        return lb;  // default orientation bounds already cover every direction
+    }
+
 private:
     point3 center1;
-    double radius;
+    real radius;
     shared_ptr<material> mat;
     bool is_moving;
     vec3 center_vec;  // delta vector between (from) center1 and (to) center2
     aabb bbox;
 
-    point3 sphere_center(double time) const {
+    point3 sphere_center(real time) const {
         // linearly interpolate from center1 to center2 
         // s.t. center(t=0) = center1, center(t=1) = center2
         return center1 + time * center_vec;
     }
 
-    static void get_sphere_uv(const point3& p, double& u, double& v) {
-        double theta = acos(-p.y());
-        double phi = atan2(-p.z(), p.x()) + pi;
+    static void get_sphere_uv(const point3& p, real& u, real& v) {
+        double theta = rtw_acos(-p.y());
+        double phi = rtw_atan2(-p.z(), p.x()) + pi;
 
         u = phi / (2.0*pi);
         v = theta / pi;
     }
+
+    static vec3 random_to_sphere(double radius, double distance_squared) {
+        // uniform direction within the cone subtended by a sphere, about +z
+        double r1 = random_double();
+        double r2 = random_double();
+        double z = 1 + r2*(sqrt(1-radius*radius/distance_squared) - 1);
+
+        double phi = 2*pi*r1;
+        double x = cos(phi)*sqrt(1-z*z);
+        double y = sin(phi)*sqrt(1-z*z);
+
+        return vec3(x, y, z);
+    }
 };
 
 #endif
\ No newline at end of file
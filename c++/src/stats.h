@@ -0,0 +1,121 @@
+#ifndef STATS_H
+#define STATS_H
+
+// Counters of the work a render does: rays per bounce, BVH nodes visited, box and primitive tests,
+// scatter calls per material and medium boundary probes.  Compiled out unless built with -DRTW_STATS,
+// when camera::render resets them at the start and reports them at the end (unless its report_stats
+// is off, as for the render server's concurrent jobs).
+//
+// Each thread counts into its own block with plain increments, no atomics or locks on the hot path.
+// A thread's block is registered once, the first time it counts, and report() sums every block, so it
+// must only be called once the threads that rendered are done.
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#ifdef RTW_STATS
+#define RTW_STAT(counter) (++render_stats::local().counter)
+#else
+#define RTW_STAT(counter) ((void)0)
+#endif
+
+enum stat_primitive { stat_sphere, stat_quad, stat_box, stat_constant_medium, stat_heterogeneous_medium, stat_primitive_kinds };
+enum stat_material { stat_lambertian, stat_metal, stat_dielectric, stat_diffuse_light, stat_isotropic, stat_material_kinds };
+
+struct render_counters {
+    static const int depths = 64;  // bounces past this are counted in the last bucket
+
+    unsigned long long rays_by_depth[depths] = {};
+    unsigned long long bvh_nodes_visited = 0;
+    unsigned long long aabb_tests = 0;
+    unsigned long long primitive_tests[stat_primitive_kinds] = {};
+    unsigned long long scatter_calls[stat_material_kinds] = {};
+    unsigned long long medium_probes = 0;  // constant_medium boundary hits, up to two per medium test
+
+    void add(const render_counters& c) {
+        for (int d = 0; d < depths; d++) rays_by_depth[d] += c.rays_by_depth[d];
+        bvh_nodes_visited += c.bvh_nodes_visited;
+        aabb_tests += c.aabb_tests;
+        for (int p = 0; p < stat_primitive_kinds; p++) primitive_tests[p] += c.primitive_tests[p];
+        for (int m = 0; m < stat_material_kinds; m++) scatter_calls[m] += c.scatter_calls[m];
+        medium_probes += c.medium_probes;
+    }
+};
+
+class render_stats {
+public:
+    // This thread's counters
+    static render_counters& local() {
+        thread_local render_counters* counters = register_thread();
+        return *counters;
+    }
+
+    static int depth_bucket(int depth) { return std::min(depth, render_counters::depths - 1); }
+
+    // Zero every thread's counters
+    static void reset() {
+        std::lock_guard<std::mutex> lock(registry_mutex());
+        for (auto& c : registry()) *c = render_counters();
+    }
+
+    // Every thread's counters added up
+    static render_counters total() {
+        std::lock_guard<std::mutex> lock(registry_mutex());
+        render_counters sum;
+        for (const auto& c : registry()) sum.add(*c);
+        return sum;
+    }
+
+    static void report(std::ostream& out) {
+        render_counters t = total();
+
+        unsigned long long rays = 0;
+        int deepest = 0;
+        for (int d = 0; d < render_counters::depths; d++) {
+            rays += t.rays_by_depth[d];
+            if (t.rays_by_depth[d]) deepest = d;
+        }
+        double per_ray = rays ? 1.0 / rays : 0.0;
+
+        out << "Render stats: " << rays << " rays\n  rays by bounce:";
+        for (int d = 0; d <= deepest; d++) out << ' ' << d << ':' << t.rays_by_depth[d];
+        out << "\n  BVH nodes visited: " << t.bvh_nodes_visited << " (" << t.bvh_nodes_visited * per_ray << " per ray)"
+            << "\n  aabb tests: " << t.aabb_tests << " (" << t.aabb_tests * per_ray << " per ray)"
+            << "\n  primitive tests:";
+
+        const char* primitives[stat_primitive_kinds] = {"sphere", "quad", "box", "constant_medium", "heterogeneous_medium"};
+        for (int p = 0; p < stat_primitive_kinds; p++) {
+            if (t.primitive_tests[p]) out << ' ' << primitives[p] << ' ' << t.primitive_tests[p];
+        }
+
+        out << "\n  scatter calls:";
+        const char* materials[stat_material_kinds] = {"lambertian", "metal", "dielectric", "diffuse_light", "isotropic"};
+        for (int m = 0; m < stat_material_kinds; m++) {
+            if (t.scatter_calls[m]) out << ' ' << materials[m] << ' ' << t.scatter_calls[m];
+        }
+
+        out << "\n  constant_medium boundary probes: " << t.medium_probes << '\n';
+    }
+
+private:
+    static std::vector<std::unique_ptr<render_counters>>& registry() {
+        static std::vector<std::unique_ptr<render_counters>> blocks;  // never shrinks, so the thread_local pointers stay valid
+        return blocks;
+    }
+
+    static std::mutex& registry_mutex() {
+        static std::mutex mutex;
+        return mutex;
+    }
+
+    static render_counters* register_thread() {
+        std::lock_guard<std::mutex> lock(registry_mutex());
+        registry().push_back(std::unique_ptr<render_counters>(new render_counters()));
+        return registry().back().get();
+    }
+};
+
+#endif
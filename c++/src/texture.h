@@ -2,14 +2,24 @@
 #define TEXTURE_H
 
 #include "rtweekend.h"
-#include "rtw_stb_image.h"
+#include "density_grid.h"
+#include "fast_math.h"
+#include "image_registry.h"
+#include "mipmap.h"
 #include "perlin.h"
 
+#include <atomic>
+
 class texture {
 public:
     virtual ~texture() = default;
 
     virtual color value(double u, double v, const point3& p) const = 0;
+
+    // Lookup filtered over a footprint `uv_width` wide in texture space. Only image textures filter
+    virtual color value(double u, double v, const point3& p, double uv_width) const {
+        return value(u, v, p);
+    }
 };
 
 
@@ -52,27 +62,40 @@ private:
 };
 
 
+// Image converted to linear floats at load time and sampled through a mip pyramid
 class image_texture : public texture {
 public:
-    image_texture(const char* filename) : image(filename) {}
+    // The image decodes in the background, textures naming the same file share it
+    image_texture(const char* filename) : pending(image_registry::global().load(filename)) {}
 
     color value(double u, double v, const point3& p) const override {
-        if (image.height() <= 0) return color(0,1,1);
+        return value(u, v, p, 0);
+    }
+
+    color value(double u, double v, const point3& p, double uv_width) const override {
+        const mipmap& texels = image();
+        if (texels.height() <= 0) return color(0,1,1);
 
-        // clamp input coords to [1,0] x [0,1]
+        // clamp input coords to [1,0] x [0,1], image rows run top to bottom
         u = interval(0, 1).clamp(u);
         v = 1.0 - interval(0,1).clamp(v);
 
-        int i = static_cast<int>(u * image.width());
-        int j = static_cast<int>(v * image.height());
-        auto pixel = image.pixel_data(i, j);
-        
-        auto color_scale = 1.0 / 255.0;
-        return color(color_scale*pixel[0], color_scale*pixel[1], color_scale*pixel[2]);
+        return texels.sample(u, v, uv_width);
     }
 
 private:
-    rtw_image image;
+    image_registry::pending_image pending;
+    mutable std::atomic<const mipmap*> texels_ptr{nullptr};
+
+    const mipmap& image() const {
+        // wait for the decode on first use only, the mipmap stays alive in `pending`
+        const mipmap* texels = texels_ptr.load(std::memory_order_acquire);
+        if (!texels) {
+            texels = pending.get().get();
+            texels_ptr.store(texels, std::memory_order_release);
+        }
+        return *texels;
+    }
 };
 
 
@@ -80,17 +103,34 @@ class noise_texture : public texture {
 public:
     noise_texture() {}
 
-    noise_texture(double _scale) : scale(_scale) {}
+    noise_texture(double _scale, unsigned int seed = 0) : noise(seed), scale(_scale) {}
+
+    // Precompute the turbulence at resolution^3 points spanning bounds, lookups inside bounds then
+    // interpolate those instead of summing 7 octaves of noise. Only octaves with a period of a few
+    // lattice cells survive, so size the lattice to the finest detail that's visible.
+    void bake(const aabb& bounds, int resolution) {
+        baked_bounds = bounds;
+        baked_turb = grid_density::sample(bounds, resolution, resolution, resolution,
+                                          [this](const point3& p) { return noise.turb(scale * p); });
+    }
 
     color value(double u, double v, const point3& p) const override {
         point3 s = scale * p;
-        return color(1,1,1) * 0.5 * (1 + sin(s.z() + 10*noise.turb(s)));
+        return color(1,1,1) * 0.5 * (1 + rtw_sin(s.z() + 10*turb(p)));
         // return color(1,1,1) * noise.turb(s);
     }
 
 private:
     perlin noise;
     double scale;
+    aabb baked_bounds;
+    shared_ptr<grid_density> baked_turb;
+
+    double turb(const point3& p) const {
+        bool baked = baked_turb && baked_bounds.x.contains(p.x()) && baked_bounds.y.contains(p.y())
+                                && baked_bounds.z.contains(p.z());
+        return baked ? baked_turb->density(p) : noise.turb(scale * p);
+    }
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,352 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+// Bounded memory cache of texture tiles paged in from disk on first use.
+//
+// Textures are first converted to a tiled file (".rtwt"): a 4 KiB header
+// followed by every mip level cut into 32x32 tiles of linear RGB floats.  The
+// header records the size and modification time of the image it was converted
+// from, and the file is converted again once they change.
+// Each tile is exactly 12 KiB, so tiles sit on page boundaries and the file
+// can be memory mapped as well as read tile by tile.  At render time tiles are
+// read on demand into a sharded LRU cache, with eviction once the cache holds
+// more than its byte budget.
+
+#include "rtweekend.h"
+#include "mipmap.h"
+#include "rtw_stb_image.h"
+#include "texture.h"
+
+#include <sys/stat.h>
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// An open tiled texture file
+class tiled_texture_file {
+public:
+    static const int tile_size = 32;
+    static const size_t tile_bytes = tile_size * tile_size * 3 * sizeof(float);
+    static const size_t header_bytes = 4096;
+
+    struct level_info {
+        uint32_t width, height;
+        uint32_t tiles_x, tiles_y;
+        uint64_t first_tile;  // file offset
+    };
+
+    // Size and modification time of the image a tiled file was converted from
+    struct source_stamp {
+        uint64_t size = 0;
+        int64_t mtime_sec = 0, mtime_nsec = 0;
+
+        bool operator==(const source_stamp& o) const {
+            return size == o.size && mtime_sec == o.mtime_sec && mtime_nsec == o.mtime_nsec;
+        }
+
+        static source_stamp of(const std::string& path) {
+            source_stamp stamp;
+            struct stat st;
+            if (stat(path.c_str(), &st) == 0) {
+                stamp.size = static_cast<uint64_t>(st.st_size);
+                stamp.mtime_sec = st.st_mtim.tv_sec;
+                stamp.mtime_nsec = st.st_mtim.tv_nsec;
+            }
+            return stamp;
+        }
+    };
+
+    ~tiled_texture_file() { if (file) std::fclose(file); }
+
+    static shared_ptr<tiled_texture_file> open(const std::string& filename) {
+        auto f = make_shared<tiled_texture_file>();
+        f->file = std::fopen(filename.c_str(), "rb");
+        if (!f->file) return nullptr;
+
+        char magic[8];
+        uint32_t version, size, count;
+        bool ok = std::fread(magic, 1, 8, f->file) == 8 && std::memcmp(magic, "RTWTEX\0\0", 8) == 0
+               && std::fread(&version, 4, 1, f->file) == 1 && version == format_version
+               && std::fread(&size, 4, 1, f->file) == 1 && size == tile_size
+               && std::fread(&count, 4, 1, f->file) == 1 && count > 0 && count < 32
+               && std::fread(&f->converted_from, sizeof(source_stamp), 1, f->file) == 1;
+        if (!ok) return nullptr;
+
+        f->levels.resize(count);
+        if (std::fread(f->levels.data(), sizeof(level_info), count, f->file) != count) return nullptr;
+
+        static std::atomic<uint32_t> next_id(0);
+        f->file_id = next_id++;
+        return f;
+    }
+
+    // Convert a decoded linear RGB image, read from the file stamped source, to a tiled file with its
+    // full mip pyramid
+    static bool write(const std::string& filename, const float* rgb, int width, int height, const source_stamp& source) {
+        // written under another name and renamed, so a reader with the old file open keeps reading it
+        std::string temporary = filename + ".tmp";
+        std::FILE* out = std::fopen(temporary.c_str(), "wb");
+        if (!out) return false;
+
+        std::vector<std::vector<float>> level_rgb(1, std::vector<float>(rgb, rgb + static_cast<size_t>(width) * height * 3));
+        std::vector<level_info> levels;
+        uint64_t offset = header_bytes;
+
+        for (int w = width, h = height; ; ) {
+            level_info info;
+            info.width = w;
+            info.height = h;
+            info.tiles_x = (w + tile_size - 1) / tile_size;
+            info.tiles_y = (h + tile_size - 1) / tile_size;
+            info.first_tile = offset;
+            levels.push_back(info);
+            offset += static_cast<uint64_t>(info.tiles_x) * info.tiles_y * tile_bytes;
+
+            if (w == 1 && h == 1) break;
+            level_rgb.push_back(mipmap::downsample(level_rgb.back(), w, h));
+            w = std::max(1, (w + 1) / 2);
+            h = std::max(1, (h + 1) / 2);
+        }
+
+        std::vector<char> header(header_bytes, 0);
+        uint32_t fields[3] = { format_version, static_cast<uint32_t>(tile_size), static_cast<uint32_t>(levels.size()) };
+        std::memcpy(header.data(), "RTWTEX\0\0", 8);
+        std::memcpy(header.data() + 8, fields, sizeof(fields));
+        std::memcpy(header.data() + 8 + sizeof(fields), &source, sizeof(source));
+        std::memcpy(header.data() + 8 + sizeof(fields) + sizeof(source), levels.data(), levels.size() * sizeof(level_info));
+        bool ok = std::fwrite(header.data(), 1, header_bytes, out) == header_bytes;
+
+        std::vector<float> tile(tile_size * tile_size * 3);
+        for (size_t l = 0; l < levels.size() && ok; l++) {
+            const level_info& info = levels[l];
+            for (uint32_t ty = 0; ty < info.tiles_y && ok; ty++) {
+                for (uint32_t tx = 0; tx < info.tiles_x && ok; tx++) {
+                    // texels past the level's edge repeat the edge
+                    for (int y = 0; y < tile_size; y++) {
+                        int sy = std::min<int>(ty*tile_size + y, info.height - 1);
+                        for (int x = 0; x < tile_size; x++) {
+                            int sx = std::min<int>(tx*tile_size + x, info.width - 1);
+                            std::memcpy(&tile[(y*tile_size + x) * 3], &level_rgb[l][(static_cast<size_t>(sy)*info.width + sx) * 3], 3 * sizeof(float));
+                        }
+                    }
+                    ok = std::fwrite(tile.data(), 1, tile_bytes, out) == tile_bytes;
+                }
+            }
+        }
+
+        ok = (std::fclose(out) == 0) && ok;
+        ok = ok && std::rename(temporary.c_str(), filename.c_str()) == 0;
+        if (!ok) std::remove(temporary.c_str());
+        return ok;
+    }
+
+    uint32_t id() const { return file_id; }
+    int level_count() const { return static_cast<int>(levels.size()); }
+    const level_info& level(int l) const { return levels[l]; }
+    const source_stamp& source() const { return converted_from; }
+
+    bool read_tile(int l, int tx, int ty, float* texels) const {
+        const level_info& info = levels[l];
+        uint64_t offset = info.first_tile + (static_cast<uint64_t>(ty) * info.tiles_x + tx) * tile_bytes;
+
+        std::lock_guard<std::mutex> lock(io_mutex);
+        return std::fseek(file, static_cast<long>(offset), SEEK_SET) == 0
+            && std::fread(texels, 1, tile_bytes, file) == tile_bytes;
+    }
+
+private:
+    static const uint32_t format_version = 2;  // 2 added the source stamp
+
+    std::FILE* file = nullptr;
+    mutable std::mutex io_mutex;
+    std::vector<level_info> levels;
+    source_stamp converted_from;
+    uint32_t file_id = 0;
+};
+
+
+class texture_cache {
+public:
+    typedef shared_ptr<const std::vector<float>> tile_ptr;
+
+    explicit texture_cache(size_t capacity_bytes) : capacity(capacity_bytes) {}
+
+    // The process wide cache, sized by $RTW_TEXTURE_CACHE_MB (default 256 MiB)
+    static texture_cache& global() {
+        static texture_cache cache(default_capacity());
+        return cache;
+    }
+
+    // Tile (tx,ty) of mip level l, read from disk if it isn't resident
+    tile_ptr tile(const tiled_texture_file& file, int l, int tx, int ty) {
+        uint64_t key = (static_cast<uint64_t>(file.id()) << 48) | (static_cast<uint64_t>(l) << 40)
+                     | (static_cast<uint64_t>(ty) << 20) | static_cast<uint64_t>(tx);
+        shard& s = shards[(key * 0x9E3779B97F4A7C15ull) >> 60];
+
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            auto it = s.entries.find(key);
+            if (it != s.entries.end()) {
+                s.lru.splice(s.lru.begin(), s.lru, it->second.position);  // most recently used
+                hits++;
+                return it->second.texels;
+            }
+        }
+
+        // Miss: read outside the shard lock so other lookups aren't held up by the disk
+        misses++;
+        auto texels = make_shared<std::vector<float>>(tiled_texture_file::tile_size * tiled_texture_file::tile_size * 3, 0.0f);
+        if (!file.read_tile(l, tx, ty, texels->data())) {
+            std::cerr << "ERROR: Could not read texture tile " << tx << ',' << ty << " of level " << l << ".\n";
+        }
+
+        std::lock_guard<std::mutex> lock(s.mutex);
+        auto it = s.entries.find(key);
+        if (it != s.entries.end()) return it->second.texels;  // another thread got there first
+
+        s.lru.push_front(key);
+        s.entries[key] = entry{texels, s.lru.begin()};
+        s.bytes += tiled_texture_file::tile_bytes;
+        resident += tiled_texture_file::tile_bytes;
+
+        while (s.bytes > capacity / shard_count && s.lru.size() > 1) {
+            // tiles still being sampled stay alive through their shared_ptr
+            s.entries.erase(s.lru.back());
+            s.lru.pop_back();
+            s.bytes -= tiled_texture_file::tile_bytes;
+            resident -= tiled_texture_file::tile_bytes;
+        }
+
+        return texels;
+    }
+
+    size_t lookups() const { return hits + misses; }
+    size_t resident_bytes() const { return resident; }
+    double hit_rate() const {
+        size_t total = lookups();
+        return total ? static_cast<double>(hits) / total : 0.0;
+    }
+
+    void report(std::ostream& out) const {
+        out << "Texture cache: " << lookups() << " tile lookups, hit rate " << 100 * hit_rate() << "%, "
+            << resident_bytes() / (1024.0*1024.0) << " of " << capacity / (1024.0*1024.0) << " MiB resident\n";
+    }
+
+private:
+    static const int shard_count = 16;
+
+    struct entry {
+        tile_ptr texels;
+        std::list<uint64_t>::iterator position;
+    };
+
+    struct shard {
+        std::mutex mutex;
+        std::list<uint64_t> lru;  // front := most recently used
+        std::unordered_map<uint64_t, entry> entries;
+        size_t bytes = 0;
+    };
+
+    size_t capacity;
+    shard shards[shard_count];
+    std::atomic<size_t> hits{0}, misses{0}, resident{0};
+
+    static size_t default_capacity() {
+        const char* mb = getenv("RTW_TEXTURE_CACHE_MB");
+        size_t megabytes = mb ? static_cast<size_t>(atol(mb)) : 256;
+        return std::max<size_t>(megabytes, 1) * 1024 * 1024;
+    }
+};
+
+
+// Image texture paged in tile by tile through texture_cache::global(), for texture sets larger than memory.
+// `filename` is a .rtwt file, or any image, which is converted to <image>.rtwt the first time it is used
+class cached_image_texture : public texture {
+public:
+    cached_image_texture(const char* filename) {
+        rtw_search_image(filename, [this](const std::string& path) { return open(path); });
+        if (!file) std::cerr << "ERROR: Could not load image file '" << filename << "'.\n";
+    }
+
+    color value(double u, double v, const point3& p) const override {
+        return value(u, v, p, 0);
+    }
+
+    color value(double u, double v, const point3& p, double uv_width) const override {
+        if (!file) return color(0,1,1);
+
+        u = interval(0, 1).clamp(u);
+        v = 1.0 - interval(0,1).clamp(v);
+
+        const auto& base = file->level(0);
+        double lod = mip_level(uv_width, base.width, base.height);
+        int last = file->level_count() - 1;
+
+        if (lod <= 0) return bilinear(0, u, v);
+        if (lod >= last) return bilinear(last, u, v);
+
+        int l = static_cast<int>(lod);
+        double t = lod - l;
+        return (1-t) * bilinear(l, u, v) + t * bilinear(l+1, u, v);
+    }
+
+private:
+    shared_ptr<tiled_texture_file> file;
+
+    bool open(const std::string& path) {
+        bool is_tiled = path.size() > 5 && path.compare(path.size() - 5, 5, ".rtwt") == 0;
+        std::string tiled_path = is_tiled ? path : path + ".rtwt";
+
+        file = tiled_texture_file::open(tiled_path);
+        if (is_tiled) return file != nullptr;
+
+        // preconvert the source image once, later runs open the tiled file directly until the image changes
+        auto source = tiled_texture_file::source_stamp::of(path);
+        bool missing = source == tiled_texture_file::source_stamp();  // the tiled file is all there is
+        if (file && (file->source() == source || missing)) return true;
+        file = nullptr;
+
+        rtw_float_image image;
+        if (!image.load(path)) return false;
+        if (!tiled_texture_file::write(tiled_path, image.pixel_data(0, 0), image.width(), image.height(), source)) {
+            std::cerr << "ERROR: Could not write tiled texture '" << tiled_path << "'.\n";
+            return false;
+        }
+
+        file = tiled_texture_file::open(tiled_path);
+        return file != nullptr;
+    }
+
+    color bilinear(int l, double u, double v) const {
+        const auto& info = file->level(l);
+        const int ts = tiled_texture_file::tile_size;
+
+        // one cache lookup per tile touched, usually just one
+        int last_tx = -1, last_ty = -1;
+        texture_cache::tile_ptr tile;
+
+        auto texel = [&](int x, int y) {
+            x = std::min<int>(std::max(x, 0), info.width - 1);
+            y = std::min<int>(std::max(y, 0), info.height - 1);
+            if (x / ts != last_tx || y / ts != last_ty) {
+                last_tx = x / ts;
+                last_ty = y / ts;
+                tile = texture_cache::global().tile(*file, l, last_tx, last_ty);
+            }
+            const float* t = &(*tile)[((y % ts) * ts + (x % ts)) * 3];
+            return color(t[0], t[1], t[2]);
+        };
+
+        return bilinear_filter(texel, info.width, info.height, u, v);
+    }
+};
+
+#endif
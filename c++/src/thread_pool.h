@@ -0,0 +1,93 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads running submitted tasks, highest priority first and in order within
+// a priority.  A running task is never preempted
+class thread_pool {
+public:
+    explicit thread_pool(int n_threads) {
+        n_threads = std::max(1, n_threads);
+        for (int t = 0; t < n_threads; t++) {
+            workers.emplace_back([this]() { work(); });
+        }
+    }
+
+    ~thread_pool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& worker : workers) worker.join();
+    }
+
+    // Shared pool with one thread per hardware thread
+    static thread_pool& global() {
+        static thread_pool pool(static_cast<int>(std::thread::hardware_concurrency()));
+        return pool;
+    }
+
+    int size() const { return static_cast<int>(workers.size()); }
+
+    // Queue f() to run on a worker, the future gives its result (or exception)
+    template <typename F>
+    auto submit(F f, int priority = 0) -> std::future<decltype(f())> {
+        typedef decltype(f()) result_type;
+        auto task = std::make_shared<std::packaged_task<result_type()>>(f);
+        std::future<result_type> result = task->get_future();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push(queued_task{priority, submitted++, [task]() { (*task)(); }});
+        }
+        wake.notify_one();
+
+        return result;
+    }
+
+private:
+    struct queued_task {
+        int priority;
+        unsigned long long order;
+        std::function<void()> run;
+    };
+
+    struct runs_later {
+        bool operator()(const queued_task& a, const queued_task& b) const {
+            return a.priority != b.priority ? a.priority < b.priority : a.order > b.order;
+        }
+    };
+
+    std::vector<std::thread> workers;
+    std::priority_queue<queued_task, std::vector<queued_task>, runs_later> tasks;
+    unsigned long long submitted = 0;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    void work() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this]() { return stopping || !tasks.empty(); });
+                if (tasks.empty()) return;  // stopping, and nothing left to do
+                task = tasks.top().run;
+                tasks.pop();
+            }
+            task();
+        }
+    }
+};
+
+#endif
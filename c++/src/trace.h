@@ -0,0 +1,141 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// Timeline of what the renderer spends its time on, written as Chrome trace JSON
+// (open it in chrome://tracing or ui.perfetto.dev).
+//
+// Tracing is on when $RTW_TRACE names the file to write, and trace::write() is called at the end
+// of main().  Each thread appends finished spans to its own buffer with no locking, the buffers
+// are only gathered by write(), so it must be called once the traced work is done.  When tracing
+// is off a span costs a test of one flag.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class trace {
+    struct thread_buffer;
+
+public:
+    static bool enabled() {
+        static const bool on = std::getenv("RTW_TRACE") != nullptr;
+        return on;
+    }
+
+    // Records the time from its construction to its destruction as one span on this thread's track.
+    // A null name records nothing.  `detail` and `index` show up as the span's arguments
+    class span {
+    public:
+        explicit span(const char* name, const std::string& detail = std::string(), int index = -1)
+            : name(enabled() ? name : nullptr) {
+            if (!this->name) return;
+            buffer = &local();  // registers the thread when the span starts, so threads are numbered by their first span
+            this->detail = detail;
+            this->index = index;
+            start = now_us();
+        }
+
+        ~span() {
+            if (name) buffer->events.push_back(event{name, detail, index, start, now_us() - start});
+        }
+
+        span(const span&) = delete;
+        span& operator=(const span&) = delete;
+
+    private:
+        const char* name;
+        std::string detail;
+        int index = -1;
+        double start = 0;
+        thread_buffer* buffer = nullptr;
+    };
+
+    // Writes every thread's spans to $RTW_TRACE
+    static void write() {
+        if (!enabled()) return;
+        const char* filename = std::getenv("RTW_TRACE");
+
+        std::FILE* out = std::fopen(filename, "w");
+        if (!out) {
+            std::cerr << "ERROR: Could not write the trace '" << filename << "'.\n";
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(registry_mutex());
+        std::fprintf(out, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+        bool first = true;
+        for (size_t tid = 0; tid < registry().size(); tid++) {
+            const thread_buffer& b = *registry()[tid];
+            std::fprintf(out, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %zu, \"args\": {\"name\": \"thread %zu\"}}",
+                         first ? "" : ",\n", tid, tid);
+            first = false;
+
+            for (const event& e : b.events) {
+                std::fprintf(out, ",\n{\"name\": \"%s\", \"cat\": \"rtw\", \"ph\": \"X\", \"pid\": 1, \"tid\": %zu, "
+                                  "\"ts\": %.3f, \"dur\": %.3f, \"args\": {",
+                             escaped(e.name).c_str(), tid, e.start, e.duration);
+                if (!e.detail.empty()) std::fprintf(out, "\"detail\": \"%s\"", escaped(e.detail).c_str());
+                if (e.index >= 0) std::fprintf(out, "%s\"index\": %d", e.detail.empty() ? "" : ", ", e.index);
+                std::fprintf(out, "}}");
+            }
+        }
+        std::fprintf(out, "\n]}\n");
+
+        if (std::fclose(out) != 0) std::cerr << "ERROR: Could not write the trace '" << filename << "'.\n";
+        else std::clog << "Trace written to " << filename << '\n';
+    }
+
+private:
+    struct event {
+        const char* name;
+        std::string detail;
+        int index;
+        double start, duration;  // microseconds
+    };
+
+    struct thread_buffer {
+        std::vector<event> events;
+    };
+
+    static double now_us() {
+        static const auto epoch = std::chrono::steady_clock::now();
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - epoch).count();
+    }
+
+    static thread_buffer& local() {
+        thread_local thread_buffer* buffer = register_thread();
+        return *buffer;
+    }
+
+    static std::vector<std::unique_ptr<thread_buffer>>& registry() {
+        static std::vector<std::unique_ptr<thread_buffer>> buffers;  // in the order threads first traced, never shrinks
+        return buffers;
+    }
+
+    static std::mutex& registry_mutex() {
+        static std::mutex mutex;
+        return mutex;
+    }
+
+    static thread_buffer* register_thread() {
+        std::lock_guard<std::mutex> lock(registry_mutex());
+        registry().push_back(std::unique_ptr<thread_buffer>(new thread_buffer()));
+        return registry().back().get();
+    }
+
+    static std::string escaped(const std::string& s) {
+        std::string e;
+        for (char c : s) {
+            if (c == '"' || c == '\\') e += '\\';
+            if (static_cast<unsigned char>(c) >= 0x20) e += c;
+        }
+        return e;
+    }
+};
+
+#endif
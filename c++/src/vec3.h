@@ -1,54 +1,140 @@
 #ifndef VEC3_H
 #define VEC3_H
 
+#include "precision.h"
+
 #include <cmath>
 #include <iostream>
 
-using std::sqrt;
-
-class vec3 {
-public:
-    double e[3];
-
-    vec3() : e{0,0,0} {}
-    vec3(double e0, double e1, double e2) : e{e0, e1, e2} {}
-
-    double x() const { return e[0]; }
-    double y() const { return e[1]; }
-    double z() const { return e[2]; }
+// Optional SIMD backend, chosen at compile time with -DRTW_SIMD_VEC3: SSE for float, AVX2 for double
+// (-DRTW_USE_DOUBLE), the scalar code otherwise.  The lanes do the same IEEE operations in the same
+// order as the scalar code, so results don't depend on the backend.  It's off by default as one
+// vector per register only pays off where whole vectors are combined: dot products need a horizontal
+// sum and vec3(x,y,z) a gather, which cost more than the scalar code gcc already schedules well.
+#if defined(RTW_SIMD_VEC3) && !defined(RTW_USE_DOUBLE) && defined(__SSE__)
+#define RTW_VEC3_SSE
+#include <xmmintrin.h>
+#elif defined(RTW_SIMD_VEC3) && defined(RTW_USE_DOUBLE) && defined(__AVX2__)
+#define RTW_VEC3_AVX
+#include <immintrin.h>
+#endif
+
+#if defined(RTW_VEC3_SSE)
+typedef __m128 vec3_lanes;
+inline vec3_lanes lanes_load(const real* e) { return _mm_loadu_ps(e); }
+inline void lanes_store(real* e, vec3_lanes v) { _mm_storeu_ps(e, v); }
+inline vec3_lanes lanes_set1(real t) { return _mm_set1_ps(t); }
+inline vec3_lanes lanes_add(vec3_lanes a, vec3_lanes b) { return _mm_add_ps(a, b); }
+inline vec3_lanes lanes_sub(vec3_lanes a, vec3_lanes b) { return _mm_sub_ps(a, b); }
+inline vec3_lanes lanes_mul(vec3_lanes a, vec3_lanes b) { return _mm_mul_ps(a, b); }
+inline vec3_lanes lanes_neg(vec3_lanes a) { return _mm_xor_ps(a, _mm_set1_ps(-0.0f)); }  // flips the sign of zeros too
+inline vec3_lanes lanes_yzx(vec3_lanes a) { return _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1)); }
+inline vec3_lanes lanes_zxy(vec3_lanes a) { return _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 1, 0, 2)); }
+inline real lanes_sum3(vec3_lanes a) {
+    // (x + y) + z, ignoring the padding lane
+    __m128 xy = _mm_add_ss(a, _mm_shuffle_ps(a, a, _MM_SHUFFLE(1, 1, 1, 1)));
+    return _mm_cvtss_f32(_mm_add_ss(xy, _mm_movehl_ps(a, a)));
+}
+#elif defined(RTW_VEC3_AVX)
+typedef __m256d vec3_lanes;
+inline vec3_lanes lanes_load(const real* e) { return _mm256_loadu_pd(e); }
+inline void lanes_store(real* e, vec3_lanes v) { _mm256_storeu_pd(e, v); }
+inline vec3_lanes lanes_set1(real t) { return _mm256_set1_pd(t); }
+inline vec3_lanes lanes_add(vec3_lanes a, vec3_lanes b) { return _mm256_add_pd(a, b); }
+inline vec3_lanes lanes_sub(vec3_lanes a, vec3_lanes b) { return _mm256_sub_pd(a, b); }
+inline vec3_lanes lanes_mul(vec3_lanes a, vec3_lanes b) { return _mm256_mul_pd(a, b); }
+inline vec3_lanes lanes_neg(vec3_lanes a) { return _mm256_xor_pd(a, _mm256_set1_pd(-0.0)); }
+inline vec3_lanes lanes_yzx(vec3_lanes a) { return _mm256_permute4x64_pd(a, _MM_SHUFFLE(3, 0, 2, 1)); }
+inline vec3_lanes lanes_zxy(vec3_lanes a) { return _mm256_permute4x64_pd(a, _MM_SHUFFLE(3, 1, 0, 2)); }
+inline real lanes_sum3(vec3_lanes a) {
+    __m128d xy = _mm256_castpd256_pd128(a);
+    __m128d zw = _mm256_extractf128_pd(a, 1);
+    return _mm_cvtsd_f64(_mm_add_sd(_mm_add_sd(xy, _mm_unpackhi_pd(xy, xy)), zw));
+}
+#endif
 
-    vec3 operator-() const { return vec3(-e[0], -e[1], -e[2]); }
-    double operator[](int i) const { return e[i]; };
-    double& operator[](int i) { return e[i]; }
+#if defined(RTW_VEC3_SSE) || defined(RTW_VEC3_AVX)
+#define RTW_VEC3_SIMD
+#endif
 
-    vec3& operator+=(const vec3 &v) {
-        e[0] += v.e[0];
-        e[1] += v.e[1];
-        e[2] += v.e[2];
+class alignas(16) vec3 {
+public:
+#if defined(RTW_VEC3_SSE)
+    // the register itself, so chains of operations stay in registers instead of going through e
+    union {
+        vec3_lanes v;
+        real e[4];  // x, y, z and a zero padding lane
+    };
+
+    explicit vec3(vec3_lanes lanes) : v(lanes) {}
+    vec3_lanes lanes() const { return v; }
+#elif defined(RTW_VEC3_AVX)
+    // a __m256d member would need 32 byte alignment, which C++11 allocation doesn't give, so load and store
+    real e[4];  // x, y, z and a zero padding lane
+
+    explicit vec3(vec3_lanes lanes) { lanes_store(e, lanes); }
+    vec3_lanes lanes() const { return lanes_load(e); }
+#else
+    real e[4];  // x, y, z and a zero padding lane, so a vector is exactly one SIMD register
+#endif
+
+    vec3() : e{0,0,0,0} {}
+    vec3(real e0, real e1, real e2) : e{e0, e1, e2, 0} {}
+
+    real x() const { return e[0]; }
+    real y() const { return e[1]; }
+    real z() const { return e[2]; }
+
+    vec3 operator-() const {
+#ifdef RTW_VEC3_SIMD
+        return vec3(lanes_neg(lanes()));
+#else
+        return vec3(-e[0], -e[1], -e[2]);
+#endif
+    }
+    real operator[](int i) const { return e[i]; };
+    real& operator[](int i) { return e[i]; }
+
+    vec3& operator+=(const vec3 &other) {
+#ifdef RTW_VEC3_SIMD
+        *this = vec3(lanes_add(lanes(), other.lanes()));
+#else
+        e[0] += other.e[0];
+        e[1] += other.e[1];
+        e[2] += other.e[2];
+#endif
         return *this;
     }
 
-    vec3& operator*=(const double &t) {
+    vec3& operator*=(const real &t) {
+#ifdef RTW_VEC3_SIMD
+        *this = vec3(lanes_mul(lanes(), lanes_set1(t)));
+#else
         e[0] *= t;
         e[1] *= t;
         e[2] *= t;
+#endif
         return *this;
     }
 
-    vec3& operator/=(double t) {
+    vec3& operator/=(real t) {
         return *this *= 1/t;
     }
 
-    double length() const {
+    real length() const {
         return sqrt(length_squared());
     }
 
-    double length_squared() const {
+    real length_squared() const {
+#ifdef RTW_VEC3_SIMD
+        return lanes_sum3(lanes_mul(lanes(), lanes()));
+#else
         return e[0]*e[0] + e[1]*e[1] + e[2]*e[2];
+#endif
     }
 
     bool near_zero() const {  // Return true if the vector is close to zero in all dimensions
-        double s = 1e-8;
+        real s = 1e-8;
         return (fabs(e[0]) < s) && (fabs(e[1]) < s) && (fabs(e[2]) < s);
     }
 
@@ -56,7 +142,7 @@ public:
         return vec3(random_double(), random_double(), random_double());
     }
 
-    static vec3 random(double min, double max) {
+    static vec3 random(real min, real max) {
         return vec3(random_double(min, max), random_double(min, max), random_double(min, max));
     }
 };
@@ -68,37 +154,63 @@ inline std::ostream& operator<<(std::ostream &out, const vec3 &v) {
 }
 
 inline vec3 operator+(const vec3 &u, const vec3 &v) {
+#ifdef RTW_VEC3_SIMD
+    return vec3(lanes_add(u.lanes(), v.lanes()));
+#else
     return vec3(u.e[0] + v.e[0], u.e[1] + v.e[1], u.e[2] + v.e[2]);
+#endif
 }
 
 inline vec3 operator-(const vec3 &u, const vec3 &v) {
+#ifdef RTW_VEC3_SIMD
+    return vec3(lanes_sub(u.lanes(), v.lanes()));
+#else
     return vec3(u.e[0] - v.e[0], u.e[1] - v.e[1], u.e[2] - v.e[2]);
+#endif
 }
 
 inline vec3 operator*(const vec3 &u, const vec3 &v) {  // element wise mulitplication
+#ifdef RTW_VEC3_SIMD
+    return vec3(lanes_mul(u.lanes(), v.lanes()));
+#else
     return vec3(u.e[0] * v.e[0], u.e[1] * v.e[1], u.e[2] * v.e[2]);
+#endif
 }
 
-inline vec3 operator*(const double t, const vec3 &u) {
+inline vec3 operator*(const real t, const vec3 &u) {
+#ifdef RTW_VEC3_SIMD
+    return vec3(lanes_mul(lanes_set1(t), u.lanes()));
+#else
     return vec3(t * u.e[0], t * u.e[1], t * u.e[2]);
+#endif
 }
 
-inline vec3 operator*(const vec3 &u, const double t) {
+inline vec3 operator*(const vec3 &u, const real t) {
     return t * u;
 }
 
-inline vec3 operator/(const vec3 &v, const double t) {
+inline vec3 operator/(const vec3 &v, const real t) {
     return (1/t) * v;
 }
 
-inline double dot(const vec3 &u, const vec3 &v) {
+inline real dot(const vec3 &u, const vec3 &v) {
+#ifdef RTW_VEC3_SIMD
+    return lanes_sum3(lanes_mul(u.lanes(), v.lanes()));
+#else
     return u.e[0] * v.e[0] + u.e[1] * v.e[1] + u.e[2] * v.e[2];
+#endif
 }
 
 inline vec3 cross(const vec3 &u, const vec3 &v) {
+#ifdef RTW_VEC3_SIMD
+    // u.yzx * v.zxy - u.zxy * v.yzx
+    vec3_lanes a = u.lanes(), b = v.lanes();
+    return vec3(lanes_sub(lanes_mul(lanes_yzx(a), lanes_zxy(b)), lanes_mul(lanes_zxy(a), lanes_yzx(b))));
+#else
     return vec3(u.e[1] * v.e[2] - u.e[2] * v.e[1], 
                 u.e[2] * v.e[0] - u.e[0] * v.e[2], 
                 u.e[0] * v.e[1] - u.e[1] * v.e[0]);
+#endif
 }
 
 inline vec3 unit_vector(const vec3 &v) {
@@ -140,8 +252,8 @@ inline vec3 reflect(const vec3 &v, const vec3 &n) {
     return v - 2*(dot(v, n)*n);
 }
 
-inline vec3 refract(const vec3& uv, const vec3& n, double etai_over_etat) {
-    double cos_theta = fmin(dot(-uv, n), 1.0);
+inline vec3 refract(const vec3& uv, const vec3& n, real etai_over_etat) {
+    real cos_theta = fmin(dot(-uv, n), 1.0);
     vec3 r_out_perp = etai_over_etat * (uv + cos_theta*n);
     vec3 r_out_parallel = -sqrt(fabs(1.0 - r_out_perp.length_squared())) * n;
     return r_out_perp + r_out_parallel;
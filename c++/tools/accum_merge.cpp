@@ -0,0 +1,91 @@
+// Adds up accumulation files (see src/accumulation.h) from renders of the same image, e.g. passes run
+// on different machines with different --seed values, and writes the sum and/or its image.  Files of
+// another view or scene than the first are refused.
+//
+//   accum_merge [-o merged.rtwacc] [--ppm image.ppm] [--pfm image.pfm] a.rtwacc b.rtwacc ...
+//
+// The merged file can be merged again, or given to a render as its --checkpoint to add more samples.
+//
+//   make accum_merge   (from c++/src)
+
+#include "accumulation.h"
+#include "pfm.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+int main(int argc, char* argv[]) {
+    std::string merged_file, ppm_file, pfm_file;
+    std::vector<std::string> inputs;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-o" && i + 1 < argc) merged_file = argv[++i];
+        else if (arg == "--ppm" && i + 1 < argc) ppm_file = argv[++i];
+        else if (arg == "--pfm" && i + 1 < argc) pfm_file = argv[++i];
+        else inputs.push_back(arg);
+    }
+    if (inputs.empty() || (merged_file.empty() && ppm_file.empty() && pfm_file.empty())) {
+        std::cerr << "usage: accum_merge [-o merged.rtwacc] [--ppm image.ppm] [--pfm image.pfm] <accumulation files>\n";
+        return 2;
+    }
+
+    accumulation_buffer sum;
+    for (size_t n = 0; n < inputs.size(); n++) {
+        accumulation_buffer part;
+        if (!part.read(inputs[n])) {
+            std::cerr << "ERROR: Could not read the accumulation file '" << inputs[n] << "'.\n";
+            return 1;
+        }
+        if (n == 0) {
+            sum = part;
+        } else if (part.width != sum.width || part.height != sum.height) {
+            std::cerr << "ERROR: '" << inputs[n] << "' is " << part.width << 'x' << part.height << ", not "
+                      << sum.width << 'x' << sum.height << ".\n";
+            return 1;
+        } else if (!sum.add(part)) {
+            std::cerr << "ERROR: '" << inputs[n] << "' is of another view or scene than '" << inputs[0] << "'.\n";
+            return 1;
+        }
+        std::clog << inputs[n] << ": " << part.total_samples() << " samples\n";
+    }
+
+    uint64_t fewest = ~uint64_t(0), most = 0;
+    for (const auto& p : sum.pixels) {
+        fewest = std::min(fewest, p.samples);
+        most = std::max(most, p.samples);
+    }
+    std::clog << "Merged " << inputs.size() << " files: " << sum.width << 'x' << sum.height << ", "
+              << fewest << " to " << most << " samples per pixel\n";
+
+    if (!merged_file.empty() && !sum.write(merged_file)) {
+        std::cerr << "ERROR: Could not write '" << merged_file << "'.\n";
+        return 1;
+    }
+
+    if (!ppm_file.empty()) {
+        std::ofstream out(ppm_file);
+        out << "P3\n" << sum.width << ' ' << sum.height << "\n255\n";
+        for (const auto& p : sum.pixels) write_color(out, p.mean(), 1);
+        out.close();
+        if (!out) {
+            std::cerr << "ERROR: Could not write '" << ppm_file << "'.\n";
+            return 1;
+        }
+    }
+
+    if (!pfm_file.empty()) {
+        std::vector<float> rgb;
+        for (const auto& p : sum.pixels) {
+            color c = p.mean();
+            for (int i = 0; i < 3; i++) rgb.push_back(static_cast<float>(c[i]));
+        }
+        if (!write_pfm(pfm_file, rgb.data(), sum.width, sum.height)) {
+            std::cerr << "ERROR: Could not write '" << pfm_file << "'.\n";
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,49 @@
+// Converts a scene file between its text and binary forms (see src/scene_file.h).
+//
+//   scene_convert in.rtws out.rtwb    text to binary
+//   scene_convert in.rtwb out.rtws    binary to text
+//
+// The input's form is detected from its first bytes, the output is binary when its name ends in
+// .rtwb and text otherwise.  Statements are copied as they're read, so any size of scene converts
+// in constant memory.
+//
+//   make scene_convert   (from c++/src)
+
+#include "scene_file.h"
+
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        std::cerr << "usage: scene_convert <input scene> <output scene>\n";
+        return 2;
+    }
+
+    std::string output = argv[2];
+    bool binary = output.size() > 5 && output.compare(output.size() - 5, 5, ".rtwb") == 0;
+
+    std::FILE* out = std::fopen(output.c_str(), "wb");
+    if (!out) {
+        std::cerr << "ERROR: Could not write '" << output << "'.\n";
+        return 1;
+    }
+
+    std::string error;
+    bool ok;
+    if (binary) {
+        scene_binary_writer writer(out);
+        ok = parse_scene_file(argv[1], writer, error);
+    } else {
+        scene_text_writer writer(out);
+        ok = parse_scene_file(argv[1], writer, error);
+    }
+    ok = (std::fclose(out) == 0) && ok;
+
+    if (!ok) {
+        std::cerr << "ERROR: Could not convert '" << argv[1] << "': " << (error.empty() ? "write failed" : error) << ".\n";
+        return 1;
+    }
+    return 0;
+}